@@ -0,0 +1,342 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/* Times the main operations of ncdu on a directory tree, such as one made by
+ * gentree, and writes the results as JSON to stdout. Every phase runs a
+ * number of times; the minimum and median are reported. */
+
+#include "global.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+
+#define MAX_RUNS 64
+
+struct phase {
+  const char *name;
+  int n;
+  double wall[MAX_RUNS], cpu[MAX_RUNS];
+  double items, bytes; /* per run */
+};
+
+static struct timeval wall_start;
+static double cpu_start;
+static long dirs, files, hlinks;
+static int64_t tree_size;
+
+
+static double cputime(void) {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+
+static void start(void) {
+  gettimeofday(&wall_start, NULL);
+  cpu_start = cputime();
+}
+
+
+static void stop(struct phase *p) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  if(p->n < MAX_RUNS) {
+    p->wall[p->n] = (now.tv_sec - wall_start.tv_sec) + (now.tv_usec - wall_start.tv_usec) / 1e6;
+    p->cpu[p->n++] = cputime() - cpu_start;
+  }
+}
+
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+
+static void print_phase(struct phase *p, int last) {
+  double w[MAX_RUNS], c[MAX_RUNS];
+  memcpy(w, p->wall, p->n*sizeof(double));
+  memcpy(c, p->cpu, p->n*sizeof(double));
+  qsort(w, p->n, sizeof(double), cmp_double);
+  qsort(c, p->n, sizeof(double), cmp_double);
+  printf("    \"%s\": ", p->name);
+  if(!p->n) {
+    printf("null%s\n", last ? "" : ",");
+    return;
+  }
+  printf("{\"runs\": %d, \"wall_min\": %.6f, \"wall_median\": %.6f, \"cpu_min\": %.6f, \"cpu_median\": %.6f",
+    p->n, w[0], w[p->n/2], c[0], c[p->n/2]);
+  if(p->items > 0)
+    printf(", \"items_per_s\": %.0f", p->items / w[p->n/2]);
+  if(p->bytes > 0)
+    printf(", \"bytes_per_s\": %.0f", p->bytes / w[p->n/2]);
+  printf("}%s\n", last ? "" : ",");
+}
+
+
+static void print_string(const char *s) {
+  putchar('"');
+  for(; *s; s++) {
+    if(*s == '"' || *s == '\\')
+      putchar('\\');
+    if((unsigned char)*s < 0x20)
+      printf("\\u%04x", *s);
+    else
+      putchar(*s);
+  }
+  putchar('"');
+}
+
+
+static int drop_caches(void) {
+  FILE *f;
+  sync();
+  if((f = fopen("/proc/sys/vm/drop_caches", "w")) == NULL)
+    return 0;
+  fputs("3\n", f);
+  return fclose(f) == 0;
+}
+
+
+/* Runs dir_process() until the output is done */
+static int process(void) {
+  while(pstate == ST_CALC)
+    if(dir_process())
+      return 1;
+  return 0;
+}
+
+
+static struct dir *scan(const char *path) {
+  dir_mem_init(NULL);
+  dir_scan_init(path);
+  if(process() || !dirlist_par) {
+    fprintf(stderr, "Scanning %s failed.\n", path);
+    exit(1);
+  }
+  return getroot(dirlist_par);
+}
+
+
+static void release(struct dir *root) {
+  dirlist_open(NULL);
+  freedir(root);
+}
+
+
+static void count(struct dir *d) {
+  struct dir *t;
+  if(d->flags & FF_DIR)
+    dirs++;
+  else
+    files++;
+  if(d->flags & FF_HLNKC)
+    hlinks++;
+  for(t=d->sub; t; t=t->next)
+    count(t);
+}
+
+
+/* Gives an existing tree to the in-memory output again, which measures
+ * building the tree without any I/O. With nolinks the files aren't treated as
+ * hard links, the difference is the cost of resolving them. */
+static void replay(struct dir *d, int nolinks) {
+  static struct dir *buf;
+  static struct dir_ext ext;
+  struct dir *t;
+
+  if(!buf)
+    buf = xmalloc(dir_memsize(""));
+  memcpy(buf, d, offsetof(struct dir, name));
+  buf->parent = buf->next = buf->prev = buf->sub = buf->hlnk = NULL;
+  buf->items = 0;
+  buf->flags &= ~(FF_TOP|FF_SCAN|FF_HIDN|FF_BSEL|FF_MARK|FF_GONE);
+  if(nolinks)
+    buf->flags &= ~FF_HLNKC;
+  if(d->flags & FF_EXT)
+    ext = *dir_ext_ptr(d);
+  dir_output.item(buf, d->name, &ext, d->flags & FF_HLNKC ? 2 : 0);
+  if(d->flags & FF_DIR) {
+    for(t=d->sub; t; t=t->next)
+      replay(t, nolinks);
+    dir_output.item(NULL, NULL, NULL, 0);
+  }
+}
+
+
+static void sort_all(struct dir *d) {
+  struct dir *t;
+  dirlist_open(d);
+  while(dirlist_idle())
+    ;
+  for(t=d->sub; t; t=t->next)
+    if(t->flags & FF_DIR && t->sub)
+      sort_all(t);
+}
+
+
+static void usage(void) {
+  printf("ncdu-bench [options] <dir>\n\n");
+  printf("  -r RUNS      Number of runs of every phase (3)\n");
+  printf("  -o FILE      Export file to use (ncdu-bench-export.json in $TMPDIR)\n");
+  printf("  -e           Enable extended information\n");
+  exit(0);
+}
+
+
+int main(int argc, char **argv) {
+  static struct phase cold = {.name = "scan_cold"}, warm = {.name = "scan_warm"},
+    export = {.name = "export"}, import = {.name = "import"}, sort = {.name = "sort"},
+    build = {.name = "build"}, nolinks = {.name = "build_nolinks"};
+  static const int cols[] = { DL_COL_NAME, DL_COL_SIZE, DL_COL_ITEMS, DL_COL_MTIME };
+  char *path, *exportfn = NULL, tmp[4096];
+  struct dir *root, *copy;
+  struct stat st;
+  int c, i, j, runs = 3, cold_ok;
+
+  while((c = getopt(argc, argv, "r:o:eh")) != -1) {
+    switch(c) {
+    case 'r': runs = atoi(optarg); break;
+    case 'o': exportfn = optarg; break;
+    case 'e': extended_info = 1; break;
+    default: usage();
+    }
+  }
+  if(optind != argc-1)
+    usage();
+  if(runs < 1 || runs > MAX_RUNS)
+    runs = runs < 1 ? 1 : MAX_RUNS;
+  if((path = path_real(argv[optind])) == NULL) {
+    fprintf(stderr, "Can't open %s: %s\n", argv[optind], strerror(errno));
+    return 1;
+  }
+  if(!exportfn) {
+    snprintf(tmp, sizeof(tmp), "%s/ncdu-bench-export.json", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    exportfn = tmp;
+  }
+  dir_ui = 0;
+
+  /* scanning, from disk and from the cache of the OS */
+  cold_ok = drop_caches();
+  for(i=0; i<runs; i++) {
+    if(cold_ok && drop_caches()) {
+      start();
+      root = scan(path);
+      stop(&cold);
+      release(root);
+    }
+    start();
+    root = scan(path);
+    stop(&warm);
+    if(i < runs-1)
+      release(root);
+  }
+  count(root);
+  tree_size = root->size;
+  cold.items = warm.items = dirs + files;
+  cold.bytes = warm.bytes = tree_size;
+
+  /* exporting while scanning, and importing that */
+  for(i=0; i<runs; i++) {
+    if(dir_export_init(exportfn)) {
+      fprintf(stderr, "Can't open %s: %s\n", exportfn, strerror(errno));
+      return 1;
+    }
+    dir_scan_init(path);
+    start();
+    process();
+    stop(&export);
+
+    dir_mem_init(NULL);
+    if(dir_import_init(exportfn)) {
+      fprintf(stderr, "Can't open %s: %s\n", exportfn, strerror(errno));
+      return 1;
+    }
+    start();
+    process();
+    stop(&import);
+    if(dirlist_par)
+      release(getroot(dirlist_par));
+  }
+  export.items = import.items = dirs + files;
+  if(stat(exportfn, &st) == 0)
+    export.bytes = import.bytes = st.st_size;
+  unlink(exportfn);
+
+  /* building the tree in memory, with and without hard links */
+  for(i=0; i<runs; i++) {
+    for(j=0; j<2; j++) {
+      dir_mem_init(NULL);
+      start();
+      replay(root, j);
+      dir_output.final(0);
+      stop(j ? &nolinks : &build);
+      copy = getroot(dirlist_par);
+      release(copy);
+    }
+  }
+  build.items = nolinks.items = dirs + files;
+
+  /* sorting every directory by every column, with and without natsort */
+  dirlist_open(root);
+  for(i=0; i<runs; i++) {
+    start();
+    for(j=0; j<8; j++) {
+      dirlist_natsort = j & 1;
+      dirlist_set_sort(cols[j/2], 1, 0);
+      dirlist_invalidate(NULL);
+      sort_all(root);
+    }
+    stop(&sort);
+  }
+  sort.items = (dirs + files) * 8.0;
+
+  printf("{\n");
+  printf("  \"path\": ");
+  print_string(path);
+  printf(",\n");
+  printf("  \"dirs\": %ld,\n  \"files\": %ld,\n  \"hardlinks\": %ld,\n  \"size\": %" PRId64 ",\n", dirs, files, hlinks, tree_size);
+  printf("  \"extended\": %s,\n", extended_info ? "true" : "false");
+  printf("  \"cold_cache\": %s,\n", cold_ok ? "true" : "false");
+  printf("  \"phases\": {\n");
+  print_phase(&cold, 0);
+  print_phase(&warm, 0);
+  print_phase(&export, 0);
+  print_phase(&import, 0);
+  print_phase(&build, 0);
+  print_phase(&nolinks, 0);
+  print_phase(&sort, 1);
+  printf("  }\n}\n");
+
+  release(root);
+  free(path);
+  return 0;
+}
@@ -0,0 +1,277 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/* Generates a reproducible directory tree to benchmark ncdu on. With -N, the
+ * tree is written as a number of snapshots in the layout of a Time Machine
+ * backup, where the files that didn't change since the previous snapshot are
+ * hard links to it. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef HAVE_INTTYPES_H
+# include <inttypes.h>
+#endif
+#ifdef HAVE_STDINT_H
+# include <stdint.h>
+#endif
+
+
+static int depth = 4;        /* levels of subdirectories */
+static int fanout = 8;       /* average number of subdirectories */
+static int files = 16;       /* average number of files per directory */
+static long median = 4096;   /* median file size */
+static long maxsize = 16<<20;
+static int namelen = 12;     /* average name length */
+static int unicode = 5;      /* % of names with non-ASCII characters */
+static int snapshots = 0;
+static int changed = 5;      /* % of files changed between snapshots */
+static uint64_t seed = 1;
+static int sparse = 0;
+
+static long ndirs, nfiles, nlinks;
+static int64_t nbytes;
+
+
+/* xorshift64*, the tree has to be the same on every machine */
+static uint64_t rnd(uint64_t *s) {
+  *s ^= *s >> 12;
+  *s ^= *s << 25;
+  *s ^= *s >> 27;
+  return *s * 2685821657736338717ULL;
+}
+
+/* Uniform in [0,n) */
+static long rndn(uint64_t *s, long n) {
+  return n > 0 ? (long)(rnd(s) >> 11) % n : 0;
+}
+
+/* Around avg, between avg/2 and avg*3/2 */
+static long around(uint64_t *s, long avg) {
+  return avg/2 + rndn(s, avg+1);
+}
+
+/* Roughly log-normal around the median, like the file sizes on most disks */
+static long filesize(uint64_t *s) {
+  double e = (rndn(s, 1000) + rndn(s, 1000) + rndn(s, 1000)) / 1000.0 - 1.5;
+  double sz = median;
+  int i;
+  for(i=0; i<8; i++)
+    sz *= e > 0 ? 1.0 + e/2 : 1.0 / (1.0 - e/2);
+  if(!rndn(s, 50)) /* the occasional empty file */
+    return 0;
+  return sz > maxsize ? maxsize : (long)sz;
+}
+
+
+static void randname(uint64_t *s, char *buf, long idx) {
+  static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 _-.";
+  static const char *wide[] = { "\xc3\xa9", "\xc3\xbc", "\xc3\xb8", "\xe6\x97\xa5", "\xe2\x82\xac" };
+  int i, len = (int)around(s, namelen);
+  int uni = rndn(s, 100) < unicode;
+  char *p = buf;
+
+  for(i=0; i<len; i++) {
+    if(uni && !rndn(s, 4)) {
+      strcpy(p, wide[rndn(s, 5)]);
+      p += strlen(p);
+    } else
+      *(p++) = chars[i == 0 ? rndn(s, 62) : rndn(s, sizeof(chars)-1)];
+  }
+  /* unique within the directory */
+  sprintf(p, "~%lx", idx);
+}
+
+
+static void die(const char *what, const char *path) {
+  fprintf(stderr, "%s %s: %s\n", what, path, strerror(errno));
+  exit(1);
+}
+
+
+static void writefile(const char *path, long size) {
+  static char buf[65536];
+  long n;
+  int fd;
+
+  if((fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0)
+    die("Can't create", path);
+  if(sparse) {
+    if(ftruncate(fd, size) < 0)
+      die("Can't write", path);
+  } else {
+    if(!buf[0])
+      memset(buf, 'x', sizeof(buf));
+    for(; size > 0; size -= n) {
+      n = size < (long)sizeof(buf) ? size : (long)sizeof(buf);
+      if(write(fd, buf, n) != n)
+        die("Can't write", path);
+    }
+  }
+  close(fd);
+}
+
+
+/* Writes a directory. The structure comes from st, which is seeded the same
+ * for every snapshot; ch decides which files changed since prev. */
+static void gen(char *path, char *prev, int level, uint64_t *st, uint64_t *ch) {
+  size_t plen = strlen(path), prlen = prev ? strlen(prev) : 0;
+  long i, n, size;
+
+  if(mkdir(path, 0755) < 0 && errno != EEXIST)
+    die("Can't create", path);
+  ndirs++;
+
+  n = around(st, files);
+  for(i=0; i<n; i++) {
+    path[plen] = '/';
+    randname(st, path+plen+1, i);
+    size = filesize(st);
+    if(prev && rndn(ch, 100) >= changed) {
+      prev[prlen] = '/';
+      strcpy(prev+prlen+1, path+plen+1);
+      if(link(prev, path) < 0)
+        die("Can't link", path);
+      nlinks++;
+    } else {
+      if(prev)
+        size = filesize(ch);
+      writefile(path, size);
+      nfiles++;
+      nbytes += size;
+    }
+  }
+
+  if(level < depth) {
+    n = around(st, fanout);
+    for(i=0; i<n; i++) {
+      path[plen] = '/';
+      randname(st, path+plen+1, i);
+      strcat(path+plen+1, "d");
+      if(prev) {
+        prev[prlen] = '/';
+        strcpy(prev+prlen+1, path+plen+1);
+      }
+      gen(path, prev, level+1, st, ch);
+    }
+  }
+  path[plen] = 0;
+  if(prev)
+    prev[prlen] = 0;
+}
+
+
+static void usage(void) {
+  printf("gentree [options] <dir>\n\n");
+  printf("  -d DEPTH     Levels of subdirectories (%d)\n", depth);
+  printf("  -f FANOUT    Average number of subdirectories per directory (%d)\n", fanout);
+  printf("  -n FILES     Average number of files per directory (%d)\n", files);
+  printf("  -s SIZE      Median file size in bytes (%ld)\n", median);
+  printf("  -m SIZE      Largest file size in bytes (%ld)\n", maxsize);
+  printf("  -l LEN       Average name length (%d)\n", namelen);
+  printf("  -u PERCENT   Names with non-ASCII characters (%d)\n", unicode);
+  printf("  -N COUNT     Write COUNT Time Machine-like snapshots (plain tree)\n");
+  printf("  -c PERCENT   Files changed between snapshots (%d)\n", changed);
+  printf("  -S SEED      Random seed (%d)\n", (int)seed);
+  printf("  -z           Create sparse files instead of writing the data\n");
+  exit(0);
+}
+
+
+int main(int argc, char **argv) {
+  char *path, *prev = NULL, *dir;
+  uint64_t st, ch;
+  int c, i;
+
+  while((c = getopt(argc, argv, "d:f:n:s:m:l:u:N:c:S:zh")) != -1) {
+    switch(c) {
+    case 'd': depth = atoi(optarg); break;
+    case 'f': fanout = atoi(optarg); break;
+    case 'n': files = atoi(optarg); break;
+    case 's': median = atol(optarg); break;
+    case 'm': maxsize = atol(optarg); break;
+    case 'l': namelen = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+    case 'u': unicode = atoi(optarg); break;
+    case 'N': snapshots = atoi(optarg); break;
+    case 'c': changed = atoi(optarg); break;
+    case 'S': seed = strtoull(optarg, NULL, 10); break;
+    case 'z': sparse = 1; break;
+    default: usage();
+    }
+  }
+  if(optind != argc-1)
+    usage();
+  dir = argv[optind];
+
+  /* names are at most namelen*2*3 bytes, plus the suffix */
+  path = malloc(strlen(dir) + 64 + (depth+2)*(namelen*6+32));
+  if(snapshots > 0)
+    prev = malloc(strlen(dir) + 64 + (depth+2)*(namelen*6+32));
+
+  if(mkdir(dir, 0755) < 0 && errno != EEXIST)
+    die("Can't create", dir);
+
+  if(snapshots <= 0) {
+    st = seed ? seed : 1;
+    strcpy(path, dir);
+    gen(path, NULL, 0, &st, &st);
+  } else {
+    sprintf(path, "%s/Backups.backupdb", dir);
+    if(mkdir(path, 0755) < 0 && errno != EEXIST)
+      die("Can't create", path);
+    strcat(path, "/bench");
+    if(mkdir(path, 0755) < 0 && errno != EEXIST)
+      die("Can't create", path);
+    for(i=0; i<snapshots; i++) {
+      st = seed ? seed : 1;
+      ch = (seed ? seed : 1) * 0x9e3779b97f4a7c15ULL + i;
+      sprintf(path, "%s/Backups.backupdb/bench/2024-01-%02d-120000", dir, i+1);
+      if(mkdir(path, 0755) < 0 && errno != EEXIST)
+        die("Can't create", path);
+      strcat(path, "/Data");
+      if(i > 0)
+        sprintf(prev, "%s/Backups.backupdb/bench/2024-01-%02d-120000/Data", dir, i);
+      gen(path, i > 0 ? prev : NULL, 0, &st, &ch);
+    }
+    sprintf(path, "%s/Backups.backupdb/bench/Latest", dir);
+    sprintf(prev, "2024-01-%02d-120000", snapshots);
+    unlink(path);
+    if(symlink(prev, path) < 0)
+      die("Can't create", path);
+  }
+
+  printf("{\"dirs\": %ld, \"files\": %ld, \"links\": %ld, \"bytes\": %" PRId64 "}\n", ndirs, nfiles, nlinks, nbytes);
+  free(path);
+  free(prev);
+  return 0;
+}
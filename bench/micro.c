@@ -0,0 +1,523 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/* Microbenchmarks of the functions that the time of a scan, an import or
+ * sorting in the browser goes to, each on an in-memory fixture so that they
+ * can be measured without any I/O. Every kernel is run until it has enough
+ * samples and has run long enough; the minimum, median and median absolute
+ * deviation per operation are written as JSON to stdout. */
+
+#include "global.h"
+#include "strnatcmp.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+
+#define MAX_SAMPLES 1000
+#define SMALL_DIR   200  /* items in the small directories, sorted with qsort() */
+#define EXCLUDES    200  /* number of exclude patterns */
+
+/* A kernel does ops operations per run. setup() and teardown(), when set, are
+ * called around every run and are not timed. */
+struct kernel {
+  const char *name;
+  void (*setup)(void);
+  void (*run)(void);
+  void (*teardown)(void);
+  long ops;
+  int64_t bytes; /* per run */
+};
+
+static long n = 10000;
+static uint64_t seed = 1;
+
+static char **names;          /* n file names */
+static char **paths;          /* n/10 full paths, for exclude_match() */
+static struct dir *sort_root; /* a directory of n items and n/SMALL_DIR of SMALL_DIR items */
+static struct dir *tree;      /* n files in n/50 directories, every third a hard link */
+static struct dir **leaves;
+static long nleaves;
+static char importfn[4096];
+
+
+/* xorshift64*, the same as gentree */
+static uint64_t rnd(void) {
+  seed ^= seed >> 12;
+  seed ^= seed << 25;
+  seed ^= seed >> 27;
+  return seed * 2685821657736338717ULL;
+}
+
+static long rndn(long m) {
+  return m > 0 ? (long)(rnd() >> 11) % m : 0;
+}
+
+
+/* Something like the names in a home directory: numbered photos and versions
+ * for the natural sort, some non-ASCII, some long, some with characters that
+ * have to be escaped in an export. */
+static char *mkname(void) {
+  static const char *words[] = {
+    "report", "IMG_", "libfoo.so.", "chapter", "Screenshot 2024-01-", "backup",
+    "node_modules", "résumé", "データ", "notes", "v", "track ", "index", "draft"
+  };
+  static const char *exts[] = { "", ".txt", ".jpg", ".c", ".o", ".pdf", ".tar.gz", ".md", ".mp3", "~" };
+  char buf[256];
+  int i, l;
+
+  l = snprintf(buf, 64, "%s%ld%s", words[rndn(sizeof(words)/sizeof(*words))], rndn(rndn(4) ? 100 : 100000),
+    exts[rndn(sizeof(exts)/sizeof(*exts))]);
+  if(!rndn(20))
+    for(i=rndn(120); i>0 && l<200; i--)
+      buf[l++] = 'a' + rndn(26);
+  if(!rndn(200))
+    buf[l++] = rndn(2) ? '"' : '\t';
+  buf[l] = 0;
+  return xstrdup(buf);
+}
+
+
+static struct dir *mkitem(struct dir *parent, const char *name, int flags) {
+  struct dir *d = xcalloc(1, dir_ext_memsize(name));
+  struct dir_ext *e;
+
+  strcpy(d->name, name);
+  d->flags = flags | FF_EXT;
+  e = dir_ext_ptr(d);
+  e->mtime = 1600000000 + rndn(100000000);
+  e->mode = flags & FF_DIR ? 040755 : 0100644;
+  e->flags = FFE_MTIME|FFE_MODE;
+  if(!(flags & FF_DIR)) {
+    d->asize = rndn(rndn(10) ? 65536 : 1<<30);
+    d->size = (d->asize + 4095) & ~4095;
+  }
+  d->parent = parent;
+  if(parent) {
+    d->next = parent->sub;
+    if(d->next)
+      d->next->prev = d;
+    parent->sub = d;
+    parent->items++;
+    parent->size += d->size;
+    parent->asize += d->asize;
+  }
+  return d;
+}
+
+
+static void fixtures(void) {
+  struct dir **dirs, *d;
+  char buf[64];
+  long i, ndirs;
+
+  names = xmalloc(n * sizeof(*names));
+  for(i=0; i<n; i++)
+    names[i] = mkname();
+
+  paths = xmalloc(n/10 * sizeof(*paths));
+  for(i=0; i<n/10; i++) {
+    snprintf(buf, sizeof(buf), "/Users/user/src/project%ld/src/module%ld/", rndn(20), rndn(50));
+    paths[i] = xmalloc(strlen(buf) + strlen(names[i]) + 1);
+    strcpy(paths[i], buf);
+    strcat(paths[i], names[i]);
+  }
+
+  /* patterns of which only a few ever match */
+  exclude_add("*.o");
+  exclude_add(".git");
+  exclude_add("node_modules");
+  for(i=3; i<EXCLUDES; i++) {
+    snprintf(buf, sizeof(buf), i % 3 ? "*.ext%ld" : i % 2 ? "/Volumes/disk%ld/*" : "cache%ld", i);
+    exclude_add(buf);
+  }
+
+  sort_root = mkitem(NULL, "", FF_DIR);
+  d = mkitem(sort_root, "large", FF_DIR);
+  for(i=0; i<n; i++)
+    mkitem(d, names[i], rndn(10) ? FF_FILE : FF_DIR);
+  for(i=0; i<n/SMALL_DIR; i++) {
+    snprintf(buf, sizeof(buf), "small%ld", i);
+    d = mkitem(sort_root, buf, FF_DIR);
+    for(ndirs=0; ndirs<SMALL_DIR; ndirs++)
+      mkitem(d, names[rndn(n)], rndn(10) ? FF_FILE : FF_DIR);
+  }
+
+  /* half of the directories go deeper below the last few, the rest anywhere */
+  ndirs = n/50 + 1;
+  dirs = xmalloc(ndirs * sizeof(*dirs));
+  dirs[0] = tree = mkitem(NULL, "/Volumes/.timemachine", FF_DIR);
+  for(i=1; i<ndirs; i++)
+    dirs[i] = mkitem(dirs[rndn(2) ? rndn(i) : i - 1 - rndn(i < 4 ? i : 4)], names[rndn(n)], FF_DIR);
+  leaves = xmalloc(n * sizeof(*leaves));
+  for(i=0; i<n; i++) {
+    d = leaves[nleaves++] = mkitem(dirs[rndn(ndirs)], names[i], FF_FILE);
+    if(i % 3 == 0) {
+      d->flags |= FF_HLNKC;
+      d->dev = 1;
+      d->ino = i / 9 + 1;
+    } else
+      d->ino = n + i;
+  }
+  free(dirs);
+}
+
+
+/* Gives a fixture tree to dir_output, the same way as the scanner does */
+static void replay(struct dir *d, int nolinks) {
+  static struct dir *buf;
+  struct dir *t;
+
+  if(!buf)
+    buf = xmalloc(dir_memsize(""));
+  if(d->parent)
+    dir_curpath_enter(d->name);
+  else
+    dir_curpath_set(d->name);
+  memcpy(buf, d, offsetof(struct dir, name));
+  buf->parent = buf->next = buf->prev = buf->sub = buf->hlnk = NULL;
+  buf->items = 0;
+  if(nolinks)
+    buf->flags &= ~FF_HLNKC;
+  dir_output.item(buf, d->name, dir_ext_ptr(d), d->flags & FF_HLNKC ? 3 : 0);
+  if(d->flags & FF_DIR) {
+    for(t=d->sub; t; t=t->next)
+      replay(t, nolinks);
+    dir_output.item(NULL, NULL, NULL, 0);
+  }
+  if(d->parent)
+    dir_curpath_leave();
+}
+
+
+/* dirlist_sort() relinks the list in place, every run starts from a random
+ * order again */
+static void shuffle(struct dir *d) {
+  static struct dir **list;
+  static long size;
+  struct dir *t;
+  long i, j, len = 0;
+
+  for(t=d->sub; t; t=t->next) {
+    if(len == size) {
+      size = size ? size*2 : 1024;
+      list = xrealloc(list, size * sizeof(*list));
+    }
+    list[len++] = t;
+  }
+  for(i=len-1; i>0; i--) {
+    j = rndn(i+1);
+    t = list[i];
+    list[i] = list[j];
+    list[j] = t;
+  }
+  for(i=0; i<len; i++) {
+    list[i]->prev = i ? list[i-1] : NULL;
+    list[i]->next = i+1 < len ? list[i+1] : NULL;
+  }
+  d->sub = list[0];
+}
+
+static void sort_setup_large(void) {
+  struct dir *t;
+  for(t=sort_root->sub; t; t=t->next)
+    if(!strcmp(t->name, "large"))
+      shuffle(t);
+  dirlist_invalidate(NULL);
+}
+
+static void sort_setup_small(void) {
+  struct dir *t;
+  for(t=sort_root->sub; t; t=t->next)
+    if(strcmp(t->name, "large"))
+      shuffle(t);
+  dirlist_invalidate(NULL);
+}
+
+static void sort_large(void) {
+  struct dir *t;
+  for(t=sort_root->sub; t; t=t->next)
+    if(!strcmp(t->name, "large"))
+      dirlist_open(t);
+}
+
+static void sort_small(void) {
+  struct dir *t;
+  for(t=sort_root->sub; t; t=t->next)
+    if(strcmp(t->name, "large"))
+      dirlist_open(t);
+}
+
+#define SORT_KERNEL(fn, col, nat) \
+  static void fn##_large(void) { dirlist_sort_col = col; dirlist_natsort = nat; sort_setup_large(); } \
+  static void fn##_small(void) { dirlist_sort_col = col; dirlist_natsort = nat; sort_setup_small(); }
+SORT_KERNEL(name,    DL_COL_NAME,  0)
+SORT_KERNEL(natname, DL_COL_NAME,  1)
+SORT_KERNEL(size,    DL_COL_SIZE,  1)
+SORT_KERNEL(mtime,   DL_COL_MTIME, 1)
+
+
+static void natcmp(void) {
+  static volatile int r;
+  long i;
+  for(i=1; i<n; i++)
+    r += strnatcmp(names[i-1], names[i]);
+  r += strnatcmp(names[n-1], names[0]);
+}
+
+
+static void exclude(void) {
+  static volatile int r;
+  long i;
+  for(i=0; i<n/10; i++)
+    r += exclude_match(paths[i]);
+}
+
+
+static void crop(void) {
+  static volatile char r;
+  long i;
+  for(i=0; i<n; i++)
+    r += cropstr(names[i], 20)[0] + cropstr(names[i], 40)[0] + cropstr(names[i], 80)[0];
+}
+
+
+static void fullpath(void) {
+  static volatile char r;
+  long i;
+  for(i=0; i<nleaves; i++)
+    r += getpath(leaves[i])[0];
+}
+
+
+static void export(void) {
+  if(dir_export_init("/dev/null")) {
+    fprintf(stderr, "Can't open /dev/null: %s\n", strerror(errno));
+    exit(1);
+  }
+  replay(tree, 0);
+  dir_output.final(0);
+}
+
+
+static int null_item(struct dir *item, const char *name, struct dir_ext *ext, unsigned int nlink) {
+  (void)item; (void)name; (void)ext; (void)nlink;
+  return 0;
+}
+
+static int null_final(int fail) {
+  return fail;
+}
+
+static void import(void) {
+  if(dir_import_init(importfn)) {
+    fprintf(stderr, "Can't open %s: %s\n", importfn, strerror(errno));
+    exit(1);
+  }
+  dir_output.item = null_item;
+  dir_output.final = null_final;
+  if(dir_process()) {
+    fprintf(stderr, "Importing %s failed.\n", importfn);
+    exit(1);
+  }
+}
+
+
+static void build(int nolinks) {
+  dir_mem_init(NULL);
+  replay(tree, nolinks);
+  dir_output.final(0);
+}
+
+static void build_links(void) {
+  build(0);
+}
+
+static void build_nolinks(void) {
+  build(1);
+}
+
+static void build_release(void) {
+  struct dir *root = getroot(dirlist_par);
+  dirlist_open(NULL);
+  freedir(root);
+}
+
+
+static struct kernel kernels[] = {
+  { .name = "dirlist_sort_name",          .setup = name_large,    .run = sort_large },
+  { .name = "dirlist_sort_name_natsort",  .setup = natname_large, .run = sort_large },
+  { .name = "dirlist_sort_size",          .setup = size_large,    .run = sort_large },
+  { .name = "dirlist_sort_mtime",         .setup = mtime_large,   .run = sort_large },
+  { .name = "dirlist_sort_small_name",    .setup = name_small,    .run = sort_small },
+  { .name = "dirlist_sort_small_natsort", .setup = natname_small, .run = sort_small },
+  { .name = "dirlist_sort_small_size",    .setup = size_small,    .run = sort_small },
+  { .name = "dirlist_sort_small_mtime",   .setup = mtime_small,   .run = sort_small },
+  { .name = "strnatcmp",                  .run = natcmp },
+  { .name = "exclude_match",              .run = exclude },
+  { .name = "cropstr",                    .run = crop },
+  { .name = "getpath",                    .run = fullpath },
+  { .name = "export",                     .run = export },
+  { .name = "import",                     .run = import },
+  { .name = "build_hlink_check",          .run = build_links, .teardown = build_release },
+  { .name = "build_nolinks",              .run = build_nolinks, .teardown = build_release },
+  { .name = NULL }
+};
+
+
+static struct kernel *find(const char *name) {
+  struct kernel *k;
+  for(k=kernels; strcmp(k->name, name); k++)
+    ;
+  return k;
+}
+
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+
+/* Runs a kernel until it has at least min samples and ran for at least
+ * mintime seconds, after a few runs to warm up the caches */
+static void measure(struct kernel *k, int min, double mintime, int last) {
+  static double s[MAX_SAMPLES], dev[MAX_SAMPLES];
+  uint64_t start, total = 0;
+  double med;
+  int i, cnt = 0;
+
+  for(i=0; i<3; i++) {
+    if(k->setup) k->setup();
+    k->run();
+    if(k->teardown) k->teardown();
+  }
+
+  while(cnt < MAX_SAMPLES && (cnt < min || total < mintime * 1e9)) {
+    if(k->setup) k->setup();
+    start = stats_now();
+    k->run();
+    s[cnt] = stats_now() - start;
+    total += s[cnt++];
+    if(k->teardown) k->teardown();
+  }
+
+  qsort(s, cnt, sizeof(double), cmp_double);
+  med = s[cnt/2];
+  for(i=0; i<cnt; i++)
+    dev[i] = s[i] > med ? s[i] - med : med - s[i];
+  qsort(dev, cnt, sizeof(double), cmp_double);
+
+  printf("    \"%s\": {\"samples\": %d, \"ops\": %ld, \"ns_per_op_min\": %.1f, \"ns_per_op_median\": %.1f, \"mad_pct\": %.2f",
+    k->name, cnt, k->ops, s[0] / k->ops, med / k->ops, med > 0 ? 100.0 * dev[cnt/2] / med : 0.0);
+  if(k->bytes)
+    printf(", \"bytes_per_s\": %.0f", k->bytes / (med / 1e9));
+  printf("}%s\n", last ? "" : ",");
+  fflush(stdout);
+}
+
+
+static void usage(void) {
+  printf("ncdu-micro [options] [kernel..]\n\n");
+  printf("  -n ITEMS     Size of the fixtures (10000)\n");
+  printf("  -r SAMPLES   Minimum number of samples of every kernel (20)\n");
+  printf("  -t SECONDS   Minimum time to run every kernel (0.5)\n");
+  printf("  -s SEED      Seed for the fixtures (1)\n");
+  printf("  -l           List the kernels\n\n");
+  printf("Only the kernels whose name contains one of the given arguments are run.\n");
+  exit(0);
+}
+
+
+static int selected(struct kernel *k, int argc, char **argv) {
+  int i;
+  if(optind >= argc)
+    return 1;
+  for(i=optind; i<argc; i++)
+    if(strstr(k->name, argv[i]))
+      return 1;
+  return 0;
+}
+
+
+int main(int argc, char **argv) {
+  struct kernel *k, *last = NULL;
+  struct stat st;
+  double mintime = 0.5;
+  int c, min = 20;
+
+  while((c = getopt(argc, argv, "n:r:t:s:lh")) != -1) {
+    switch(c) {
+    case 'n': n = atol(optarg); break;
+    case 'r': min = atoi(optarg); break;
+    case 't': mintime = atof(optarg); break;
+    case 's': seed = strtoull(optarg, NULL, 10) | 1; break;
+    case 'l':
+      for(k=kernels; k->name; k++)
+        printf("%s\n", k->name);
+      return 0;
+    default: usage();
+    }
+  }
+  if(n < 1000)
+    n = 1000;
+  if(min < 1 || min > MAX_SAMPLES)
+    min = min < 1 ? 1 : MAX_SAMPLES;
+  dir_ui = 0;
+  extended_info = 1;
+  stats_enabled = 0;
+
+  fixtures();
+  for(k=kernels; k->name; k++)
+    k->ops = strstr(k->name, "_small_") ? n/SMALL_DIR*SMALL_DIR : n;
+  find("exclude_match")->ops = n/10;
+  find("cropstr")->ops = n*3; /* at three widths */
+
+  /* the import reads what the export writes */
+  snprintf(importfn, sizeof(importfn), "%s/ncdu-micro-import.json", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+  if(dir_export_init(importfn)) {
+    fprintf(stderr, "Can't open %s: %s\n", importfn, strerror(errno));
+    return 1;
+  }
+  replay(tree, 0);
+  dir_output.final(0);
+  if(stat(importfn, &st) == 0)
+    find("import")->bytes = find("export")->bytes = st.st_size;
+
+  for(k=kernels; k->name; k++)
+    if(selected(k, argc, argv))
+      last = k;
+
+  printf("{\n  \"items\": %ld,\n  \"kernels\": {\n", n);
+  for(k=kernels; k->name; k++)
+    if(selected(k, argc, argv))
+      measure(k, min, mintime, k == last);
+  printf("  }\n}\n");
+
+  unlink(importfn);
+  return 0;
+}
@@ -0,0 +1,425 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "global.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pwd.h>
+#include <grp.h>
+#include <ncurses.h>
+#include <khashl.h>
+
+
+/* Usage of regular files and other non-directory items grouped by extension,
+ * owner, group and age. The whole-tree tables are updated by the dir_output
+ * implementations during the scan, which also has the ownership and mtime
+ * when extended information isn't kept in memory. Tables for a single
+ * directory, or for the whole tree after it has been modified, are built by
+ * walking the tree in memory. */
+
+#define EXT_MAX 12 /* longer extensions are grouped as "(other)" */
+
+#define DAY (24*3600)
+static const struct {
+  uint64_t age;
+  const char *name;
+} buckets[] = {
+  {        DAY, "< 1 day"     },
+  {      7*DAY, "< 1 week"    },
+  {     30*DAY, "< 1 month"   },
+  {     91*DAY, "< 3 months"  },
+  {    365*DAY, "< 1 year"    },
+  {  2*365*DAY, "< 2 years"   },
+  {  5*365*DAY, "< 5 years"   },
+  {          0, "5+ years"    },
+  {          0, "unknown"     }
+};
+#define AGE_BUCKETS (int)(sizeof(buckets)/sizeof(*buckets))
+#define AGE_UNKNOWN (AGE_BUCKETS-1)
+
+KHASHL_MAP_INIT(KH_LOCAL, ext_t, ext, const char *, int, kh_hash_str, kh_eq_str)
+KHASHL_MAP_INIT(KH_LOCAL, own_t, own, khint32_t, int, kh_hash_uint32, kh_eq_generic)
+
+struct agg_link {
+  uint64_t dev, ino;
+};
+#define link_hash(l) (kh_hash_uint64((khint64_t)(l).dev) ^ kh_hash_uint64((khint64_t)(l).ino))
+#define link_equal(a, b) ((a).dev == (b).dev && (a).ino == (b).ino)
+KHASHL_SET_INIT(KH_LOCAL, al_t, al, struct agg_link, link_hash, link_equal)
+
+struct agg {
+  struct agg_row *rows[AGG_TABLES];
+  int len[AGG_TABLES], size[AGG_TABLES];
+  ext_t *exts;
+  own_t *owners[2];   /* index by AGG_UID or AGG_GID minus AGG_UID */
+  al_t *links;        /* hard links that have been counted */
+  struct agg_row total;
+  uint64_t now;
+};
+
+/* The whole tree as it was scanned, and the one the view was built from */
+static struct agg whole, local;
+static int whole_valid;
+
+/* The view */
+static struct dir *scope; /* NULL for the whole tree */
+static struct agg *cur;
+static struct agg_row *view;
+static int view_len, table, sel, vtop;
+
+
+static int row_add(struct agg *a, int t, char *name, long id) {
+  struct agg_row *r;
+  if(a->len[t] >= a->size[t]) {
+    a->size[t] = a->size[t] ? a->size[t]*2 : 32;
+    a->rows[t] = xrealloc(a->rows[t], a->size[t]*sizeof(struct agg_row));
+  }
+  r = a->rows[t] + a->len[t];
+  memset(r, 0, sizeof(struct agg_row));
+  r->name = name;
+  r->id = id;
+  return a->len[t]++;
+}
+
+
+static void agg_clear(struct agg *a) {
+  int t, i;
+  for(t=0; t<AGG_TABLES; t++) {
+    for(i=0; i<a->len[t]; i++)
+      free(a->rows[t][i].name);
+    free(a->rows[t]);
+  }
+  if(a->exts)
+    ext_destroy(a->exts);
+  if(a->owners[0])
+    own_destroy(a->owners[0]);
+  if(a->owners[1])
+    own_destroy(a->owners[1]);
+  if(a->links)
+    al_destroy(a->links);
+  memset(a, 0, sizeof(struct agg));
+}
+
+
+static void agg_start(struct agg *a) {
+  int i;
+  agg_clear(a);
+  a->exts = ext_init();
+  a->owners[0] = own_init();
+  a->owners[1] = own_init();
+  a->links = al_init();
+  a->now = (uint64_t)time(NULL);
+  for(i=0; i<AGE_BUCKETS; i++)
+    row_add(a, AGG_AGE, xstrdup(buckets[i].name), -1);
+}
+
+
+static int ext_row(struct agg *a, const char *name) {
+  char buf[EXT_MAX+1];
+  const char *e = strrchr(name, '.'), *key;
+  khint_t k;
+  int i, absent;
+
+  if(!e || e == name || !e[1])
+    key = "(none)";
+  else if(strlen(e+1) > EXT_MAX)
+    key = "(other)";
+  else {
+    for(i=0; e[i+1]; i++)
+      buf[i] = e[i+1] >= 'A' && e[i+1] <= 'Z' ? e[i+1]-'A'+'a' : e[i+1];
+    buf[i] = 0;
+    key = buf;
+  }
+
+  k = ext_get(a->exts, key);
+  if(k != kh_end(a->exts))
+    return kh_val(a->exts, k);
+  i = row_add(a, AGG_EXT, xstrdup(key), -1);
+  k = ext_put(a->exts, a->rows[AGG_EXT][i].name, &absent);
+  kh_val(a->exts, k) = i;
+  return i;
+}
+
+
+static int owner_row(struct agg *a, int t, long id) {
+  own_t *h = a->owners[t-AGG_UID];
+  struct passwd *pw;
+  struct group *gr;
+  const char *name = NULL;
+  char buf[32];
+  khint_t k;
+  int i, absent;
+
+  k = own_get(h, (khint32_t)id);
+  if(k != kh_end(h))
+    return kh_val(h, k);
+
+  if(id < 0)
+    name = "unknown";
+  else if(t == AGG_UID && (pw = getpwuid((uid_t)id)) != NULL)
+    name = pw->pw_name;
+  else if(t == AGG_GID && (gr = getgrgid((gid_t)id)) != NULL)
+    name = gr->gr_name;
+  if(!name) {
+    sprintf(buf, "%ld", id);
+    name = buf;
+  }
+  i = row_add(a, t, xstrdup(name), id);
+  k = own_put(h, (khint32_t)id, &absent);
+  kh_val(h, k) = i;
+  return i;
+}
+
+
+static int age_row(struct agg *a, struct dir_ext *ext) {
+  uint64_t age;
+  int i;
+  if(!ext || !(ext->flags & FFE_MTIME))
+    return AGE_UNKNOWN;
+  age = a->now > ext->mtime ? a->now - ext->mtime : 0;
+  for(i=0; buckets[i].age; i++)
+    if(age < buckets[i].age)
+      break;
+  return i;
+}
+
+
+static void count(struct agg_row *r, struct dir *d) {
+  r->size = adds64(r->size, d->size);
+  r->asize = adds64(r->asize, d->asize);
+  r->items++;
+}
+
+
+static void add(struct agg *a, struct dir *d, const char *name, struct dir_ext *ext) {
+  struct agg_link l;
+  int absent, i;
+
+  if(d->flags & (FF_DIR|FF_ERR|FF_OTHFS|FF_EXL|FF_KERNFS|FF_FRMLNK))
+    return;
+  if(d->flags & FF_HLNKC) {
+    l.dev = d->dev;
+    l.ino = d->ino;
+    al_put(a->links, l, &absent);
+    if(!absent)
+      return;
+  }
+
+  count(&a->total, d);
+  i = ext_row(a, name);
+  count(a->rows[AGG_EXT]+i, d);
+  i = owner_row(a, AGG_UID, ext && ext->flags & FFE_UID ? (long)ext->uid : -1);
+  count(a->rows[AGG_UID]+i, d);
+  i = owner_row(a, AGG_GID, ext && ext->flags & FFE_GID ? (long)ext->gid : -1);
+  count(a->rows[AGG_GID]+i, d);
+  count(a->rows[AGG_AGE]+age_row(a, ext), d);
+}
+
+
+static void walk(struct agg *a, struct dir *d) {
+  for(; d; d=d->next) {
+    if(d->flags & FF_DIR)
+      walk(a, d->sub);
+    else
+      add(a, d, d->name, dir_ext_ptr(d));
+  }
+}
+
+
+void agg_reset(void) {
+  agg_start(&whole);
+  whole_valid = 1;
+}
+
+
+void agg_invalidate(void) {
+  whole_valid = 0;
+}
+
+
+void agg_item(struct dir *item, const char *name, struct dir_ext *ext) {
+  if(whole_valid)
+    add(&whole, item, name, ext);
+}
+
+
+static int row_cmp(const void *va, const void *vb) {
+  const struct agg_row *a = va, *b = vb;
+  int64_t x = show_as ? a->asize : a->size, y = show_as ? b->asize : b->size;
+  return x > y ? -1 : x < y ? 1 : strcmp(a->name, b->name);
+}
+
+
+static struct agg_row *sorted(struct agg *a, int t, int *len) {
+  struct agg_row *l = xmalloc((a->len[t] ? a->len[t] : 1)*sizeof(struct agg_row));
+  int i;
+  for(i=*len=0; i<a->len[t]; i++)
+    if(a->rows[t][i].items)
+      l[(*len)++] = a->rows[t][i];
+  if(t != AGG_AGE)
+    qsort(l, *len, sizeof(struct agg_row), row_cmp);
+  return l;
+}
+
+
+struct agg_row *agg_sorted(int t, int *len) {
+  return sorted(&whole, t, len);
+}
+
+
+static void view_open(int t) {
+  free(view);
+  table = t;
+  view = sorted(cur, t, &view_len);
+  sel = vtop = 0;
+}
+
+
+static void scope_open(struct dir *d) {
+  scope = d;
+  if(!d && whole_valid)
+    cur = &whole;
+  else {
+    agg_start(&local);
+    walk(&local, d ? d->sub : getroot(dirlist_par));
+    cur = &local;
+  }
+  view_open(table);
+}
+
+
+void agg_draw(void) {
+  int height = winrows-4, width = wincols-6, rows = height-7, i;
+  int64_t total = show_as ? cur->total.asize : cur->total.size;
+  enum ui_coltype c;
+  struct agg_row *r;
+
+  browse_draw();
+  nccreate(height, width, "Usage by group");
+
+  nctab(width-40, table == AGG_EXT, 1, "Extension");
+  nctab(width-27, table == AGG_UID, 2, "Owner");
+  nctab(width-18, table == AGG_GID, 3, "Group");
+  nctab(width-9,  table == AGG_AGE, 4, "Age");
+
+  ncprint(2, 2, "%d files in %s", cur->total.items,
+    cropstr(scope ? getpath(scope) : "the whole tree", width-30));
+  ncaddstr(3, 2, show_as ? "Apparent size" : "  Disk usage");
+  ncaddstr(3, 17, "%     Items  Name");
+
+  for(i=0; i<rows && vtop+i < view_len; i++) {
+    r = view+vtop+i;
+    c = vtop+i == sel ? UIC_SEL : UIC_DEFAULT;
+    uic_set(c);
+    mvhline(subwinr+4+i, subwinc+1, ' ', width-2);
+    move(subwinr+4+i, subwinc+2);
+    printsize(c, show_as ? r->asize : r->size);
+    uic_set(c);
+    ncprint(4+i, 14, "%5.1f", total > 0 ? (float)(show_as ? r->asize : r->size) / (float)total * 100.0f : 0.0f);
+    ncprint(4+i, 20, "%9d", r->items);
+    ncaddstrc(c, 4+i, 31, cropstr(r->name, width-33));
+  }
+
+  uic_set(UIC_DEFAULT);
+  if(!view_len)
+    ncaddstr(4, 2, "No files.");
+  ncaddstrc(UIC_KEY, height-2, width-40, "w");
+  addstrc(UIC_DEFAULT, scope ? " whole tree, " : " this directory, ");
+  addstrc(UIC_KEY, "q");
+  addstrc(UIC_DEFAULT, " to close");
+}
+
+
+int agg_key(int ch) {
+  int rows = winrows-11;
+
+  switch(ch) {
+  case '1': case '2': case '3': case '4':
+    view_open(ch-'1');
+    break;
+  case KEY_LEFT:
+  case 'h':
+    view_open((table+AGG_TABLES-1) % AGG_TABLES);
+    break;
+  case KEY_RIGHT:
+  case 'l':
+  case 9: /* tab */
+    view_open((table+1) % AGG_TABLES);
+    break;
+  case KEY_UP:
+  case 'k':
+    sel--;
+    break;
+  case KEY_DOWN:
+  case 'j':
+    sel++;
+    break;
+  case KEY_PPAGE:
+    sel -= rows;
+    break;
+  case KEY_NPAGE:
+    sel += rows;
+    break;
+  case KEY_HOME:
+    sel = 0;
+    break;
+  case KEY_END:
+    sel = view_len-1;
+    break;
+  case 'w':
+    scope_open(scope || !dirlist_par->parent ? NULL : dirlist_par);
+    break;
+  case 'a':
+    show_as = !show_as;
+    view_open(table);
+    break;
+  default:
+    agg_clear(&local);
+    free(view);
+    view = NULL;
+    pstate = ST_BROWSE;
+    return 0;
+  }
+
+  if(sel >= view_len)
+    sel = view_len-1;
+  if(sel < 0)
+    sel = 0;
+  if(sel < vtop)
+    vtop = sel;
+  if(sel >= vtop+rows)
+    vtop = sel-rows+1;
+  return 0;
+}
+
+
+void agg_init(void) {
+  pstate = ST_AGG;
+  table = AGG_EXT;
+  scope_open(dirlist_par->parent ? dirlist_par : NULL);
+}
@@ -0,0 +1,66 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef _agg_h
+#define _agg_h
+
+#include "global.h"
+
+/* Tables */
+#define AGG_EXT    0
+#define AGG_UID    1
+#define AGG_GID    2
+#define AGG_AGE    3
+#define AGG_TABLES 4
+
+struct agg_row {
+  char *name;   /* extension, user or group name, or age bucket */
+  long id;      /* uid or gid, -1 if unknown or not applicable */
+  int64_t size, asize;
+  int items;
+};
+
+/* Starts a new whole-tree aggregation, called before a new tree is built */
+void agg_reset(void);
+
+/* Marks the whole-tree aggregation as out of date after the tree has been
+ * modified, the view falls back to reading the tree in memory. */
+void agg_invalidate(void);
+
+/* To be called by the dir_output implementations for every item, with the
+ * arguments given to item(). */
+void agg_item(struct dir *item, const char *name, struct dir_ext *ext);
+
+/* Returns a copy of the non-empty rows of a whole-tree table, largest first
+ * (age buckets from new to old), and sets *len to its length. Must be freed,
+ * the row names are not copied. */
+struct agg_row *agg_sorted(int table, int *len);
+
+int  agg_key(int);
+void agg_draw(void);
+void agg_init(void);
+
+
+#endif
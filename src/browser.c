@@ -34,6 +34,33 @@
 static int info_show = 0, info_page = 0, info_start = 0;
 static const char *message = NULL;
 
+long browse_rows_drawn = 0, browse_rows_total = 0;
+
+
+/* Damage tracking. Most screen updates change little or nothing, so for every
+ * row of the screen we remember what was drawn on it and only repaint the rows
+ * that differ. Anything that draws on top of the browser must mark the rows it
+ * covers with browse_damage(), nccreate() takes care of that for popups.
+ * Changes that affect every row (sizes of the opened dir, toggled columns,
+ * terminal size, etc) are detected by comparing the framesig. */
+struct rowsig {
+  struct dir *n;
+  int64_t size, asize, mtime;
+  int items;
+  unsigned short flags;
+  char empty, valid;
+};
+
+struct framesig {
+  struct dir *dir, *par;
+  int64_t size, asize, maxs, maxa;
+  int items, rows, cols, state, show_as, graph, show_items, show_mtime;
+};
+
+static struct rowsig *rowsigs = NULL;
+static struct framesig framesig;
+static int rowsigs_len = 0;
+
 
 
 static void browse_draw_info(struct dir *dr) {
@@ -118,8 +145,10 @@ static void browse_draw_info(struct dir *dr) {
 
 
 static void browse_draw_flag(struct dir *n, int *x) {
-  addchc(n->flags & FF_BSEL ? UIC_FLAG_SEL : UIC_FLAG,
+  enum ui_coltype c = n->flags & FF_BSEL ? UIC_FLAG_SEL : UIC_FLAG;
+  addchc(c,
       n == dirlist_parent ? ' ' :
+       n->flags & FF_SCAN ? '~' :
         n->flags & FF_EXL ? '<' :
         n->flags & FF_ERR ? '!' :
        n->flags & FF_SERR ? '.' :
@@ -132,6 +161,8 @@ static void browse_draw_flag(struct dir *n, int *x) {
         n->flags & FF_DIR
         && n->sub == NULL ? 'e' :
                             ' ');
+  if(n->flags & FF_MARK)
+    addchc(c, '*');
   *x += 2;
 }
 
@@ -262,14 +293,97 @@ static void browse_draw_item(struct dir *n, int row) {
 }
 
 
+void browse_damage(int row, int rows) {
+  for(; rows > 0 && row < rowsigs_len; row++, rows--)
+    if(row >= 0)
+      rowsigs[row].valid = 0;
+}
+
+
+/* Returns whether the row needs to be repainted, and marks it as painted */
+static int browse_row_dirty(int row, struct dir *n) {
+  struct rowsig r;
+
+  memset(&r, 0, sizeof(r));
+  r.valid = 1;
+  if((r.n = n) != NULL) {
+    r.size = n->size;
+    r.asize = n->asize;
+    r.items = n->items;
+    r.flags = n->flags;
+    r.empty = n->sub == NULL;
+    if(n->flags & FF_EXT)
+      r.mtime = dir_ext_ptr(n)->mtime;
+    else if(n == dirlist_parent && n->parent->flags & FF_EXT)
+      r.mtime = dir_ext_ptr(n->parent)->mtime;
+  }
+  browse_rows_total++;
+  if(memcmp(&r, rowsigs+row, sizeof(r)) == 0)
+    return 0;
+  memcpy(rowsigs+row, &r, sizeof(r));
+  browse_rows_drawn++;
+  return 1;
+}
+
+
 void browse_draw(void) {
+  static char trashmsg[256];
+  static int64_t marksig[3];
+  int64_t m[3];
+  char msg[256];
+  struct framesig f;
   struct dir *t;
   const char *tmp;
-  int selected = 0, i;
+  int selected = 0, i, x;
 
-  erase();
+  dirlist_update();
   t = dirlist_get(0);
 
+  memset(&f, 0, sizeof(f));
+  f.dir = dirlist_par;
+  if((f.par = t ? t->parent : NULL) != NULL) {
+    f.size = f.par->size;
+    f.asize = f.par->asize;
+    f.items = f.par->items;
+  }
+  f.maxs = dirlist_maxs;
+  f.maxa = dirlist_maxa;
+  f.rows = winrows;
+  f.cols = wincols;
+  f.state = pstate;
+  f.show_as = show_as;
+  f.graph = graph;
+  f.show_items = show_items;
+  f.show_mtime = show_mtime;
+  if(winrows != rowsigs_len) {
+    rowsigs = xrealloc(rowsigs, winrows*sizeof(*rowsigs));
+    rowsigs_len = winrows;
+    browse_damage(0, winrows);
+  }
+  if(memcmp(&f, &framesig, sizeof(f)) != 0) {
+    memcpy(&framesig, &f, sizeof(f));
+    browse_damage(0, winrows);
+  }
+  trash_status(msg, sizeof(msg));
+  if(strcmp(msg, trashmsg) != 0) {
+    strcpy(trashmsg, msg);
+    browse_damage(winrows-1, 1);
+  }
+  m[0] = mark_count();
+  m[1] = m[2] = 0;
+  if(m[0])
+    mark_total(m+1, m+2);
+  if(memcmp(m, marksig, sizeof(m)) != 0) {
+    memcpy(marksig, m, sizeof(m));
+    browse_damage(winrows-1, 1);
+  }
+
+  /* nothing changed in the header and footer lines? skip to the list */
+  if(rowsigs[0].valid && rowsigs[1].valid && rowsigs[winrows-1].valid)
+    goto list;
+  rowsigs[0].valid = rowsigs[1].valid = rowsigs[winrows-1].valid = 1;
+  browse_rows_drawn += 3;
+
   /* top line - basic info */
   uic_set(UIC_HD);
   mvhline(0, 0, ' ', wincols);
@@ -311,21 +425,38 @@ void browse_draw(void) {
     printw("%d", t->parent->items);
   } else
     mvaddstr(winrows-1, 0, " No items to display.");
+  if(marksig[0]) {
+    addstrc(UIC_HD, "   Marked: ");
+    uic_set(UIC_NUM_HD);
+    printw("%d", (int)marksig[0]);
+    addstrc(UIC_HD, ", ");
+    printsize(UIC_HD, show_as ? marksig[2] : marksig[1]);
+  }
+  x = getcurx(stdscr) + 3;
+  if(*trashmsg && x < wincols-4)
+    mvaddstrc(UIC_HD, winrows-1, x, cropstr(trashmsg, wincols-x-1));
   uic_set(UIC_DEFAULT);
 
-  /* nothing to display? stop here. */
-  if(!t)
-    return;
-
+list:
   /* get start position */
   t = dirlist_top(0);
 
-  /* print the list to the screen */
-  for(i=0; t && i<winrows-3; t=dirlist_next(t),i++) {
-    browse_draw_item(t, 2+i);
+  /* print the list to the screen, clearing the rows below it */
+  for(i=0; i<winrows-3; i++) {
+    if(browse_row_dirty(2+i, t)) {
+      if(t)
+        browse_draw_item(t, 2+i);
+      else {
+        move(2+i, 0);
+        clrtoeol();
+      }
+    }
+    if(!t)
+      continue;
     /* save the selected row number for later */
     if(t->flags & FF_BSEL)
       selected = i;
+    t = dirlist_next(t);
   }
 
   /* draw message window */
@@ -349,6 +480,8 @@ int browse_key(int ch) {
   struct dir *t, *sel;
   int i, catch = 0;
 
+  dirlist_update();
+
   /* message window overwrites all keys */
   if(message) {
     message = NULL;
@@ -417,6 +550,17 @@ int browse_key(int ch) {
       dirlist_top(1);
       info_start = 0;
       break;
+    case ' ':
+      if(sel == NULL || sel == dirlist_parent)
+        break;
+      mark_toggle(sel);
+      dirlist_select(dirlist_get(1));
+      dirlist_top(1);
+      info_start = 0;
+      break;
+    case 'x':
+      mark_clear();
+      break;
     case KEY_HOME:
       dirlist_select(dirlist_next(NULL));
       dirlist_top(2);
@@ -508,6 +652,18 @@ int browse_key(int ch) {
       }
       info_show = 0;
       break;
+    case 'R':
+      if(!can_refresh) {
+        message = "Directory refresh feature disabled.";
+        break;
+      }
+      if(dirlist_par) {
+        dir_ui = 2;
+        dir_mem_init(dirlist_par);
+        dir_scan_refresh(dirlist_par);
+      }
+      info_show = 0;
+      break;
     case 'q':
       if(info_show)
         info_show = 0;
@@ -535,14 +691,30 @@ int browse_key(int ch) {
       help_init();
       info_show = 0;
       break;
+    case '/':
+      search_init();
+      info_show = 0;
+      break;
+    case 'T':
+      top_init();
+      info_show = 0;
+      break;
+    case 'U':
+      agg_init();
+      info_show = 0;
+      break;
     case 'd':
-      if(sel == NULL || sel == dirlist_parent)
+      if(!mark_count() && (sel == NULL || sel == dirlist_parent))
         break;
       if(!can_delete) {
         message = "Deletion feature disabled.";
         break;
       }
       info_show = 0;
+      if(mark_count()) {
+        delete_init_marked(sel);
+        break;
+      }
       if((t = dirlist_get(1)) == sel)
         if((t = dirlist_get(-1)) == sel || t == dirlist_parent)
           t = NULL;
@@ -572,5 +744,7 @@ void browse_init(struct dir *par) {
   pstate = ST_BROWSE;
   message = NULL;
   dirlist_open(par);
+  /* the items may have been replaced by new ones at the same addresses */
+  browse_damage(0, rowsigs_len);
 }
 
@@ -32,6 +32,13 @@ int  browse_key(int);
 void browse_draw(void);
 void browse_init(struct dir *);
 
+/* Mark the given rows of the screen as overwritten, so that the next
+ * browse_draw() repaints them */
+void browse_damage(int row, int rows);
+
+/* number of rows repainted and considered by browse_draw() */
+extern long browse_rows_drawn, browse_rows_total;
+
 
 #endif
 
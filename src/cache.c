@@ -0,0 +1,396 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "global.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+
+/* The cache file has a header followed by the tree in pre-order: a 'D' record
+ * for every directory, followed by its entries and an 'E' record, and an 'F'
+ * record for everything else. Numbers are written in native byte order, the
+ * file is only meant to be read back on the same machine. Directories have
+ * their stamp, so the scanner can tell which ones are unchanged; the header
+ * has the scan options, since these affect which items were read and how. */
+
+/* The --resume file has the same format. It is written while scanning, with
+ * the directories that aren't complete yet written without a stamp: the
+ * scanner reads these again, and reuses the complete ones below them. */
+#define CACHE_MAGIC   "ncdu-cache\n"
+#define CACHE_VERSION 1
+#define CACHE_BOM     0x01020304
+
+/* Flags that are written to the cache, the others only make sense in memory */
+#define CACHE_FLAGS (FF_DIR|FF_FILE|FF_ERR|FF_OTHFS|FF_EXL|FF_HLNKC|FF_EXT|FF_KERNFS|FF_FRMLNK)
+
+char *cache_file = NULL;
+char *resume_file = NULL;
+
+/* Minimum number of seconds between two checkpoints. It's also at least ten
+ * times as long as writing the last one took. */
+#define CHECKPOINT_INTERVAL 60
+
+static FILE *stream;
+static int failed;
+static char *error;
+
+/* Seconds it takes to read an item from disk, as measured by an earlier scan,
+ * used to estimate how much time the cache saved */
+static double cost;
+static struct timeval start;
+static int timing, used;
+static long dirs_hit, dirs_miss, items_hit;
+
+static struct timeval last_checkpoint;
+static double checkpoint_time;
+static int checkpointing, resumed, saved;
+
+
+static double elapsed(struct timeval *a, struct timeval *b) {
+  return (b->tv_sec - a->tv_sec) + (b->tv_usec - a->tv_usec) / 1e6;
+}
+
+
+static unsigned int options(void) {
+  return (dir_scan_smfs ? 1 : 0) | (follow_symlinks ? 2 : 0) | (exclude_kernfs ? 4 : 0)
+    | (cachedir_tags ? 8 : 0) | (follow_firmlinks ? 16 : 0) | (extended_info ? 32 : 0);
+}
+
+
+static void put(const void *buf, size_t len) {
+  if(!failed && fwrite(buf, len, 1, stream) != 1)
+    failed = 1;
+}
+
+
+static void get(void *buf, size_t len) {
+  if(!failed && fread(buf, len, 1, stream) != 1)
+    failed = 1;
+}
+
+
+static void put_str(const char *s) {
+  uint32_t len = strlen(s);
+  put(&len, sizeof(len));
+  put(s, len);
+}
+
+
+/* Returns a newly allocated string, or NULL on error */
+static char *get_str(void) {
+  uint32_t len = 0;
+  char *s;
+  get(&len, sizeof(len));
+  if(failed || len > 65536) {
+    failed = 1;
+    return NULL;
+  }
+  s = xmalloc(len+1);
+  get(s, len);
+  s[len] = 0;
+  return s;
+}
+
+
+/* Whether a directory can be written to a checkpoint with its stamp */
+static int complete(struct dir *d) {
+  struct dir *t;
+  if(d->flags & FF_SCAN)
+    return 0;
+  /* files that --two-pass hasn't read the size of yet */
+  for(t=d->sub; t; t=t->next)
+    if(!t->ino && !(t->flags & (FF_DIR|FF_ERR|FF_EXL|FF_OTHFS|FF_KERNFS|FF_FRMLNK)))
+      return 0;
+  return 1;
+}
+
+
+static void put_item(struct dir *d) {
+  struct dir_ext *e = dir_ext_ptr(d);
+  struct stamp s;
+  struct dir *t;
+  unsigned short flags = d->flags & CACHE_FLAGS;
+  char type = d->flags & FF_DIR ? 'D' : 'F';
+
+  put(&type, 1);
+  put(&flags, sizeof(flags));
+  put(&d->size, sizeof(d->size));
+  put(&d->asize, sizeof(d->asize));
+  put(&d->ino, sizeof(d->ino));
+  put(&d->dev, sizeof(d->dev));
+  put_str(d->name);
+  if(e)
+    put(e, sizeof(struct dir_ext));
+  if(type == 'D') {
+    if((checkpointing && !complete(d)) || !stamp_get(d, &s))
+      memset(&s, 0, sizeof(s));
+    put(&s, sizeof(s));
+    for(t=d->sub; t && !failed; t=t->next)
+      put_item(t);
+    put("E", 1);
+  }
+}
+
+
+/* Reads an item and everything below it, returns NULL at the end of a
+ * directory or on error */
+static struct dir *get_item(void) {
+  struct dir hdr, *d, *t, *last = NULL;
+  struct stamp s;
+  char type = 0, *name;
+
+  get(&type, 1);
+  if(failed || type == 'E')
+    return NULL;
+  if(type != 'D' && type != 'F') {
+    failed = 1;
+    return NULL;
+  }
+
+  memset(&hdr, 0, offsetof(struct dir, name));
+  get(&hdr.flags, sizeof(hdr.flags));
+  get(&hdr.size, sizeof(hdr.size));
+  get(&hdr.asize, sizeof(hdr.asize));
+  get(&hdr.ino, sizeof(hdr.ino));
+  get(&hdr.dev, sizeof(hdr.dev));
+  if((name = get_str()) == NULL)
+    return NULL;
+  hdr.flags &= CACHE_FLAGS;
+  if(type == 'D')
+    hdr.flags |= FF_DIR;
+  else
+    hdr.flags &= ~FF_DIR;
+
+  d = xmalloc(hdr.flags & FF_EXT ? dir_ext_memsize(name) : dir_memsize(name));
+  memcpy(d, &hdr, offsetof(struct dir, name));
+  strcpy(d->name, name);
+  free(name);
+  if(d->flags & FF_EXT)
+    get(dir_ext_ptr(d), sizeof(struct dir_ext));
+
+  if(type == 'D') {
+    get(&s, sizeof(s));
+    if(!failed && (s.mtime || s.ctime))
+      stamp_put(d, &s);
+    while(!failed && (t = get_item()) != NULL) {
+      t->parent = d;
+      if(last)
+        last->next = t;
+      else
+        d->sub = t;
+      t->prev = last;
+      last = t;
+      d->items += t->items+1;
+    }
+  }
+  return d;
+}
+
+
+static void free_rec(struct dir *d) {
+  struct dir *t, *nxt;
+  for(t=d->sub; t; t=nxt) {
+    nxt = t->next;
+    free_rec(t);
+  }
+  if(d->flags & FF_DIR)
+    stamp_forget(d);
+  free(d);
+}
+
+
+/* Reads the tree for path from file, or returns NULL if it has none. *whole
+ * is set when a scan of path covers everything the file would have, for the
+ * timing of the scan. */
+static struct dir *load(const char *file, const char *path, int *whole) {
+  char magic[sizeof(CACHE_MAGIC)-1], *root;
+  uint32_t version = 0, bom = 0, opts = 0, excl = 0;
+  double c = 0;
+  struct dir *d = NULL;
+
+  if((stream = fopen(file, "rb")) == NULL) {
+    *whole = 1;
+    return NULL;
+  }
+  failed = 0;
+  get(magic, sizeof(magic));
+  get(&version, sizeof(version));
+  get(&bom, sizeof(bom));
+  get(&opts, sizeof(opts));
+  get(&excl, sizeof(excl));
+  get(&c, sizeof(c));
+  root = get_str();
+  if(failed || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 || version != CACHE_VERSION || bom != CACHE_BOM) {
+    c = 0;
+    free(root);
+    root = NULL;
+  }
+  *whole = 0;
+  if(root && strcmp(root, path) == 0) {
+    *whole = 1;
+    if(opts == options() && excl == exclude_hash() && (d = get_item()) != NULL && failed) {
+      free_rec(d);
+      d = NULL;
+    }
+  }
+  if(file == cache_file)
+    cost = c;
+  free(root);
+  fclose(stream);
+  return d;
+}
+
+
+struct dir *cache_load(const char *path) {
+  struct dir *d = NULL;
+  int whole = 0;
+
+  if(resume_file && (d = load(resume_file, path, &whole)) != NULL) {
+    resumed = 1;
+    return d;
+  }
+  if(cache_file) {
+    d = load(cache_file, path, &whole);
+    used = d != NULL;
+  }
+  /* time the scan if it covers the whole cached tree */
+  if(whole) {
+    gettimeofday(&start, NULL);
+    timing = 1;
+  }
+  return d;
+}
+
+
+void cache_free(struct dir *d) {
+  /* the counters of the scan that used the cache */
+  dirs_hit = dir_scan_reused_dirs;
+  dirs_miss = dir_scan_read_dirs;
+  items_hit = dir_scan_reused_items;
+  free_rec(d);
+}
+
+
+static void save(const char *file, struct dir *root) {
+  char *tmp;
+  uint32_t version = CACHE_VERSION, bom = CACHE_BOM, opts = options(), excl = exclude_hash();
+
+  tmp = xmalloc(strlen(file) + 5);
+  strcpy(tmp, file);
+  strcat(tmp, ".tmp");
+  if((stream = fopen(tmp, "wb")) == NULL) {
+    free(error);
+    error = xmalloc(strlen(tmp) + 256);
+    sprintf(error, "Error writing %s: %s", tmp, strerror(errno));
+    free(tmp);
+    failed = 1;
+    return;
+  }
+  failed = 0;
+  put(CACHE_MAGIC, sizeof(CACHE_MAGIC)-1);
+  put(&version, sizeof(version));
+  put(&bom, sizeof(bom));
+  put(&opts, sizeof(opts));
+  put(&excl, sizeof(excl));
+  put(&cost, sizeof(cost));
+  put_str(getpath(root));
+  put_item(root);
+  if(fclose(stream) != 0)
+    failed = 1;
+  if(failed || rename(tmp, file) < 0) {
+    failed = 1;
+    free(error);
+    error = xmalloc(strlen(tmp) + 256);
+    sprintf(error, "Error writing %s: %s", tmp, strerror(errno));
+    unlink(tmp);
+  }
+  free(tmp);
+}
+
+
+void cache_save(struct dir *root) {
+  struct timeval now;
+  long read;
+
+  /* update the cost per item when enough items were read from disk to tell */
+  if(timing) {
+    gettimeofday(&now, NULL);
+    read = root->items+1 - dir_scan_reused_items;
+    if(read >= 1000)
+      cost = elapsed(&start, &now) / read;
+    timing = 0;
+  }
+  save(cache_file, root);
+}
+
+
+void cache_checkpoint(struct dir *root, int force) {
+  struct timeval now, end;
+
+  gettimeofday(&now, NULL);
+  if(!last_checkpoint.tv_sec)
+    last_checkpoint = now;
+  if(!force && elapsed(&last_checkpoint, &now) < CHECKPOINT_INTERVAL + 10*checkpoint_time)
+    return;
+
+  checkpointing = 1;
+  save(resume_file, root);
+  checkpointing = 0;
+  saved = !failed;
+
+  gettimeofday(&end, NULL);
+  checkpoint_time = elapsed(&now, &end);
+  last_checkpoint = end;
+}
+
+
+void cache_resume_done(void) {
+  if(resume_file && (saved || resumed))
+    unlink(resume_file);
+  saved = 0;
+}
+
+
+void cache_stats_print(void) {
+  long dirs = dirs_hit + dirs_miss;
+  if(error)
+    fprintf(stderr, "%s\n", error);
+  if(saved)
+    fprintf(stderr, "Scan interrupted, run again with --resume %s to continue.\n", resume_file);
+  if(resumed)
+    fprintf(stderr, "Resumed: %ld of %ld directories taken from %s\n", dirs_hit, dirs, resume_file);
+  if(!used)
+    return;
+  fprintf(stderr, "Cache: %ld of %ld directories unchanged (%.1f%%), %ld items reused",
+    dirs_hit, dirs, dirs ? 100.0 * dirs_hit / dirs : 0.0, items_hit);
+  if(cost > 0)
+    fprintf(stderr, ", about %.1f s saved", items_hit * cost);
+  fputc('\n', stderr);
+}
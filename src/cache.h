@@ -0,0 +1,58 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef _cache_h
+#define _cache_h
+
+#include "global.h"
+
+/* --cache FILE, NULL when not used */
+extern char *cache_file;
+
+/* --resume FILE, NULL when not used */
+extern char *resume_file;
+
+/* Reads the cache for the given path and returns it as a separate tree with
+ * stamps, for the scanner to reuse unchanged directories from. Returns NULL if
+ * there is no usable cache. A checkpoint in the --resume file comes first. */
+struct dir *cache_load(const char *path);
+
+/* Frees the tree returned by cache_load() */
+void cache_free(struct dir *);
+
+/* Writes the given tree to the cache file */
+void cache_save(struct dir *);
+
+/* Writes the tree of a new scan that is still running to the --resume file,
+ * if the last checkpoint was long enough ago or force is set */
+void cache_checkpoint(struct dir *, int force);
+
+/* Removes the --resume file when the scan completed */
+void cache_resume_done(void);
+
+/* Prints the hit rate and estimated time saved to stderr */
+void cache_stats_print(void);
+
+#endif
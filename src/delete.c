@@ -27,8 +27,12 @@
 #include "global.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
 
 
 #define DS_CONFIRM  0
@@ -37,19 +41,88 @@
 
 int delete_confirm = 1;
 
-static struct dir *root, *nextsel, *curdir;
+static struct dir *root, *nextsel, *curdir, *browsedir;
+/* Items to delete, sorted so that items in the same directory are together */
+static struct dir **targets;
+static int ntargets;
 static char ignoreerr = 0, state;
 static signed char seloption;
 static int lasterrno;
 
 
+/* Deletion is done by a pool of worker threads, with a task for every
+ * directory. A worker opens the directory relative to the fd of its parent,
+ * unlinks the files in it with unlinkat() and queues its subdirectories as new
+ * tasks. When all children of a directory have been handled it is removed,
+ * and the last worker to finish a task moves on to finishing its parent.
+ * Tasks are taken from the queue in LIFO order, which keeps the number of open
+ * directories close to the depth of the tree times the number of workers.
+ *
+ * The tree in memory is only read by the workers, since the main thread keeps
+ * drawing it. They remember the deleted files in the gone list and the
+ * deleted directories in their task, which only get FF_GONE once the workers
+ * are done. aborted and state are only accessed with the lock held. The main
+ * thread keeps the UI going while the workers are busy, and afterwards frees
+ * every deleted subtree with a single freedir(). After an abort or error the
+ * deleted items are freed without touching their parents, and the sizes are
+ * subtracted from the ancestors once per target. */
+#define DEL_MAX_THREADS 16
+
+struct deltask {
+  struct dir *d;
+  struct deltask *parent, *next, *all;
+  int fd, pending, failed, done;
+};
+
+/* Files of a directory are unlinked in batches of URING_BATCH, with a single
+ * io_uring submission per batch when the kernel supports IORING_OP_UNLINKAT */
+struct delworker {
+  struct uring *ring;
+  struct dir *files[URING_BATCH];
+  const char *names[URING_BATCH];
+  int res[URING_BATCH];
+  int nfiles;
+  int64_t freed;
+  struct dir *gone[URING_BATCH]; /* of the last batch */
+  int ngone;
+};
+
+/* Totals of the items freed below a directory */
+struct delsum {
+  int64_t size, asize;
+  int items;
+};
+
+static struct deltask *queue, *tasks;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER, wake = PTHREAD_COND_INITIALIZER,
+                      answer = PTHREAD_COND_INITIALIZER;
+static int basefd, finished, aborted, quit;
+static int inline_worker; /* no threads could be started, see delete_run() */
+static long deleted, estimate;
+static int64_t freed;
+static struct dir **gone; /* files deleted by the workers */
+static long gone_len, gone_size;
+
+
 static void delete_draw_confirm(void) {
+  const char *unit;
+  int64_t size, asize;
+  float f;
+
   nccreate(6, 60, "Confirm delete");
 
-  ncprint(1, 2, "Are you sure you want to delete \"%s\"%c",
-    cropstr(root->name, 21), root->flags & FF_DIR ? ' ' : '?');
-  if(root->flags & FF_DIR && root->sub != NULL)
-    ncprint(2, 18, "and all of its contents?");
+  if(mark_count()) {
+    mark_total(&size, &asize);
+    f = formatsize(show_as ? asize : size, &unit);
+    ncprint(1, 2, "Are you sure you want to delete the %d marked items", mark_count());
+    ncprint(2, 18, "(%.1f %s in total)?", f, unit);
+  } else {
+    ncprint(1, 2, "Are you sure you want to delete \"%s\"%c",
+      cropstr(root->name, 21), root->flags & FF_DIR ? ' ' : '?');
+    if(root->flags & FF_DIR && root->sub != NULL)
+      ncprint(2, 18, "and all of its contents?");
+  }
 
   if(seloption == 0)
     attron(A_REVERSE);
@@ -69,9 +142,13 @@ static void delete_draw_confirm(void) {
 
 
 static void delete_draw_progress(void) {
+  const char *unit;
+  float f = formatsize(freed, &unit);
+
   nccreate(6, 60, "Deleting...");
 
   ncaddstr(1, 2, cropstr(getpath(curdir), 47));
+  ncprint(2, 2, "%ld of about %ld items deleted, %.1f %s freed", deleted, estimate, f, unit);
   ncaddstr(4, 41, "Press ");
   addchc(UIC_KEY, 'q');
   addstrc(UIC_DEFAULT, " to abort");
@@ -167,79 +244,445 @@ int delete_key(int ch) {
 }
 
 
-static int delete_dir(struct dir *dr) {
-  struct dir *nxt, *cur;
+/* Queues a task for d, must be called with the lock held */
+static void task_add(struct dir *d, struct deltask *parent) {
+  struct deltask *t = xcalloc(1, sizeof(struct deltask));
+  t->d = d;
+  t->parent = parent;
+  t->fd = -1;
+  t->next = queue;
+  t->all = tasks;
+  queue = tasks = t;
+  if(parent)
+    parent->pending++;
+  pthread_cond_signal(&work);
+}
+
+
+/* Waits until the user has dealt with the current error. The inline worker
+ * runs on the main thread, so it has to handle the input itself. Must be
+ * called with the lock held. */
+static void wait_answer(void) {
+  int r;
+  while(state == DS_FAILED && !aborted) {
+    if(!inline_worker) {
+      pthread_cond_wait(&answer, &lock);
+      continue;
+    }
+    pthread_mutex_unlock(&lock);
+    r = input_handle(0);
+    pthread_mutex_lock(&lock);
+    if(r)
+      aborted = 1;
+  }
+}
+
+
+/* Reports an error to the main thread and waits for the user to decide what
+ * to do with it. Must be called with the lock held. */
+static void task_error(struct dir *d, int err) {
+  wait_answer();
+  if(ignoreerr || aborted)
+    return;
+  state = DS_FAILED;
+  lasterrno = err;
+  curdir = d;
+  pthread_cond_signal(&wake);
+  wait_answer();
+}
+
+
+/* Removes the directory of a task of which all children have been handled,
+ * and continues with its parent if this was the last child of that one. */
+static void task_finish(struct deltask *t) {
+  int pfd, err = 0, stop;
+
+  while(t) {
+    pfd = t->parent ? t->parent->fd : basefd;
+    if(t->fd >= 0)
+      close(t->fd);
+    t->fd = -1;
+    pthread_mutex_lock(&lock);
+    stop = t->failed || aborted;
+    pthread_mutex_unlock(&lock);
+    if(!stop && unlinkat(pfd, t->d->name, AT_REMOVEDIR) < 0)
+      err = errno;
+
+    pthread_mutex_lock(&lock);
+    if(err) {
+      task_error(t->d, err);
+      t->failed = 1;
+    }
+    if(!t->failed && !aborted) {
+      deleted++;
+      t->done = 1;
+    }
+    if(!t->parent) {
+      finished++;
+      pthread_cond_signal(&wake);
+    } else if(t->failed)
+      t->parent->failed = 1;
+    t = t->parent;
+    if(t && --t->pending > 0)
+      t = NULL;
+    pthread_mutex_unlock(&lock);
+    err = 0;
+  }
+}
+
+
+/* Unlinks the files collected by task_run(), with io_uring if possible */
+static int task_unlink(struct deltask *t, struct delworker *w) {
+  int i, n = 0, retry = 0;
+
+  if(w->ring && uring_unlink(w->ring, t->fd, w->names, w->nfiles, w->res) < 0) {
+    uring_close(w->ring);
+    w->ring = NULL;
+    retry = 1;
+  }
+  if(!w->ring)
+    for(i=0; i<w->nfiles; i++)
+      w->res[i] = unlinkat(t->fd, w->names[i], 0) == 0 ? 0 : errno;
+
+  for(i=0; i<w->nfiles; i++) {
+    /* files may already have been unlinked before the ring failed */
+    if(!w->res[i] || (retry && w->res[i] == ENOENT)) {
+      w->gone[w->ngone++] = w->files[i];
+      if(!(w->files[i]->flags & FF_HLNKC))
+        w->freed += w->files[i]->size;
+      n++;
+    } else {
+      pthread_mutex_lock(&lock);
+      task_error(w->files[i], w->res[i]);
+      t->failed = 1;
+      pthread_mutex_unlock(&lock);
+    }
+  }
+  w->nfiles = 0;
+
+  pthread_mutex_lock(&lock);
+  if(gone_len + w->ngone > gone_size) {
+    gone_size = gone_size ? gone_size*2 : 4096;
+    gone = xrealloc(gone, gone_size*sizeof(*gone));
+  }
+  memcpy(gone+gone_len, w->gone, w->ngone*sizeof(*gone));
+  gone_len += w->ngone;
+  pthread_mutex_unlock(&lock);
+  w->ngone = 0;
+  return n;
+}
+
+
+/* Holds off while the user is looking at an error, returns whether the
+ * deletion has been aborted */
+static int task_stop(void) {
   int r;
+  pthread_mutex_lock(&lock);
+  wait_answer();
+  r = aborted;
+  pthread_mutex_unlock(&lock);
+  return r;
+}
+
+
+static void task_run(struct deltask *t, struct delworker *w) {
+  int pfd = t->parent ? t->parent->fd : basefd, n = 0, stop;
+  struct dir *c;
+  uint64_t start = trace_begin();
+
+  if((t->fd = openat(pfd, t->d->name, O_RDONLY|O_DIRECTORY|O_NOFOLLOW)) < 0) {
+    pthread_mutex_lock(&lock);
+    task_error(t->d, errno);
+    t->failed = 1;
+    pthread_mutex_unlock(&lock);
+  } else {
+    /* checked once per subdirectory or batch of files */
+    stop = task_stop();
+    for(c=t->d->sub; c && !stop; c=c->next) {
+      if(c->flags & FF_DIR) {
+        pthread_mutex_lock(&lock);
+        task_add(c, t);
+        pthread_mutex_unlock(&lock);
+        stop = task_stop();
+        continue;
+      }
+      w->files[w->nfiles] = c;
+      w->names[w->nfiles++] = c->name;
+      if(w->nfiles == URING_BATCH) {
+        n += task_unlink(t, w);
+        stop = task_stop();
+      }
+    }
+    if(w->nfiles && !task_stop())
+      n += task_unlink(t, w);
+    w->nfiles = 0;
+  }
+
+  /* getpath() isn't safe in the workers, the name will do */
+  trace_span("delete dir", start, t->d->name, n);
+
+  /* t->pending counts the subdirectories still being worked on */
+  pthread_mutex_lock(&lock);
+  deleted += n;
+  freed += w->freed;
+  w->freed = 0;
+  n = --t->pending == 0;
+  pthread_mutex_unlock(&lock);
+  if(n)
+    task_finish(t);
+}
+
+
+static void *delete_worker(void *arg) {
+  struct delworker *w = xcalloc(1, sizeof(struct delworker));
+  struct deltask *t;
+
+  w->ring = uring_open();
+  trace_thread("delete worker");
+  pthread_mutex_lock(&lock);
+  while(1) {
+    /* the inline worker is the only one adding tasks, so it's done when the
+     * queue is empty */
+    while(!queue && !quit && !inline_worker)
+      pthread_cond_wait(&work, &lock);
+    if(quit || !queue)
+      break;
+    t = queue;
+    queue = t->next;
+    /* the task is only finished by whoever brings pending to zero, so keep a
+     * reference on it while we're adding children */
+    t->pending++;
+    pthread_mutex_unlock(&lock);
+    task_run(t, w);
+    pthread_mutex_lock(&lock);
+  }
+  pthread_mutex_unlock(&lock);
+  uring_close(w->ring);
+  free(w);
+  return arg;
+}
+
+
+/* Frees the items that have been deleted from below d and subtracts them from
+ * d, the totals are added to *s for the directories further up */
+static void delete_apply(struct dir *d, struct delsum *s) {
+  struct delsum sub = { 0, 0, 0 };
+  struct dir *c, *nxt;
+
+  for(c=d->sub; c; c=nxt) {
+    nxt = c->next;
+    if(c->flags & FF_GONE) {
+      sub.items += c->items+1;
+      freedir_deferred(c, &sub.size, &sub.asize);
+    } else if(c->flags & FF_DIR)
+      delete_apply(c, &sub);
+  }
+  if(!sub.items)
+    return;
+
+  d->size = adds64(d->size, -sub.size);
+  d->asize = adds64(d->asize, -sub.asize);
+  d->items -= sub.items;
+  dirlist_forget(d);
+  s->size += sub.size;
+  s->asize += sub.asize;
+  s->items += sub.items;
+}
+
 
-  /* check for input or screen resizes */
-  curdir = dr;
-  if(input_handle(1))
-    return 1;
-
-  /* do the actual deleting */
-  if(dr->flags & FF_DIR) {
-    if((r = chdir(dr->name)) < 0)
-      goto delete_nxt;
-    if(dr->sub != NULL) {
-      nxt = dr->sub;
-      while(nxt != NULL) {
-        cur = nxt;
-        nxt = cur->next;
-        if(delete_dir(cur))
+/* Deletes the n targets starting at list, which all have the same parent
+ * directory open as basefd. Returns 1 if the user aborted. */
+static int delete_run(struct dir **list, int n) {
+  pthread_t threads[DEL_MAX_THREADS];
+  struct deltask *t;
+  struct timespec ts;
+  struct timeval tv;
+  struct delsum sum;
+  long nt, i;
+  int dirs = 0;
+
+  finished = aborted = quit = 0;
+  gone_len = 0;
+  queue = tasks = NULL;
+  curdir = list[0];
+
+  /* Files are simply unlinked, no need for threads */
+  for(i=0; i<n; i++) {
+    if(list[i]->flags & FF_DIR) {
+      list[dirs++] = list[i];
+      continue;
+    }
+    if(unlinkat(basefd, list[i]->name, 0) == 0) {
+      deleted++;
+      if(!(list[i]->flags & FF_HLNKC))
+        freed += list[i]->size;
+      freedir(list[i]);
+    } else if(!ignoreerr) {
+      curdir = list[i];
+      state = DS_FAILED;
+      lasterrno = errno;
+      while(state == DS_FAILED)
+        if(input_handle(0))
           return 1;
+    }
+  }
+  if(!dirs)
+    return 0;
+  curdir = list[0];
+
+  nt = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+  nt = nt < 4 ? 4 : nt > DEL_MAX_THREADS ? DEL_MAX_THREADS : nt;
+
+  pthread_mutex_lock(&lock);
+  for(i=0; i<dirs; i++)
+    task_add(list[i], NULL);
+  for(i=0; i<nt; i++)
+    if(pthread_create(threads+i, NULL, delete_worker, NULL) != 0)
+      break;
+  nt = i;
+  if(!nt) {
+    inline_worker = 1;
+    pthread_mutex_unlock(&lock);
+    delete_worker(NULL);
+    pthread_mutex_lock(&lock);
+    inline_worker = 0;
+  }
+
+  while(finished < dirs && !aborted) {
+    if(state == DS_FAILED) {
+      if(input_handle(0))
+        aborted = 1;
+      if(state != DS_FAILED || aborted) {
+        curdir = list[0];
+        pthread_cond_broadcast(&answer);
       }
+      continue;
+    }
+    if(input_handle(1)) {
+      aborted = 1;
+      pthread_cond_broadcast(&answer);
+      break;
+    }
+    gettimeofday(&tv, NULL);
+    ts.tv_sec = tv.tv_sec;
+    ts.tv_nsec = (tv.tv_usec + update_delay*1000L) * 1000L;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+    pthread_cond_timedwait(&wake, &lock, &ts);
+  }
+  quit = 1;
+  pthread_cond_broadcast(&work);
+  pthread_mutex_unlock(&lock);
+  for(i=0; i<nt; i++)
+    pthread_join(threads[i], NULL);
+
+  while((t = tasks) != NULL) {
+    tasks = t->all;
+    if(t->fd >= 0)
+      close(t->fd);
+    if(t->done)
+      t->d->flags |= FF_GONE;
+    free(t);
+  }
+  for(i=0; i<gone_len; i++)
+    gone[i]->flags |= FF_GONE;
+  gone_len = 0;
+  for(i=0; i<dirs; i++) {
+    if(list[i]->flags & FF_GONE)
+      freedir(list[i]);
+    else {
+      memset(&sum, 0, sizeof(sum));
+      delete_apply(list[i], &sum);
+      if(sum.items)
+        addparentstats(list[i]->parent, -sum.size, -sum.asize, 0, -sum.items);
     }
-    if((r = chdir("..")) < 0)
-      goto delete_nxt;
-    r = dr->sub == NULL ? rmdir(dr->name) : 0;
-  } else
-    r = unlink(dr->name);
-
-delete_nxt:
-  /* error occurred, ask user what to do */
-  if(r == -1 && !ignoreerr) {
+  }
+  return aborted;
+}
+
+
+/* Deletes the n targets starting at list, which all have the same parent.
+ * Returns 1 if the rest of the targets should be skipped. */
+static int delete_group(struct dir **list, int n) {
+  int i, left = 0, r;
+  struct dir *parent;
+  uint64_t t;
+
+  /* move to the trash and let the background thread delete them, falls back
+   * to deleting them right here if that isn't possible */
+  for(i=0; i<n; i++)
+    if(!trash_enabled || trash_move(list[i]) != 0)
+      list[left++] = list[i];
+  if(!left)
+    return 0;
+
+  /* chdir */
+  if(path_chdir(getpath(list[0]->parent)) < 0 || (basefd = open(".", O_RDONLY|O_DIRECTORY)) < 0) {
+    curdir = list[0];
     state = DS_FAILED;
     lasterrno = errno;
-    curdir = dr;
     while(state == DS_FAILED)
       if(input_handle(0))
         return 1;
-  } else if(!(dr->flags & FF_DIR && dr->sub != NULL)) {
-    freedir(dr);
     return 0;
   }
-  return root == dr ? 1 : 0;
+
+  /* delete */
+  seloption = 0;
+  state = DS_PROGRESS;
+  t = trace_begin();
+  parent = list[0]->parent;
+  r = delete_run(list, left);
+  close(basefd);
+  if(t)
+    trace_span("delete", t, getpath(parent), left);
+  return r;
+}
+
+
+/* Orders targets by filesystem and parent directory */
+static int target_cmp(const void *va, const void *vb) {
+  const struct dir *a = *(struct dir * const *)va, *b = *(struct dir * const *)vb;
+  if(a->dev != b->dev)
+    return a->dev < b->dev ? -1 : 1;
+  if(a->parent != b->parent)
+    return a->parent < b->parent ? -1 : 1;
+  return 0;
 }
 
 
 void delete_process(void) {
-  struct dir *par;
+  int i, j, marked = mark_count();
 
   /* confirm */
   seloption = 1;
   while(state == DS_CONFIRM && delete_confirm)
     if(input_handle(0)) {
-      browse_init(root->parent);
+      browse_init(browsedir);
       return;
     }
 
-  /* chdir */
-  if(path_chdir(getpath(root->parent)) < 0) {
-    state = DS_FAILED;
-    lasterrno = errno;
-    while(state == DS_FAILED)
-      if(input_handle(0))
-        return;
+  /* leave the marked directory we may be in before it's freed, the progress
+   * and error screens draw the browser below them */
+  browse_init(browsedir);
+  pstate = ST_DEL;
+
+  deleted = estimate = 0;
+  freed = 0;
+  for(i=0; i<ntargets; i++)
+    estimate += targets[i]->items+1;
+  for(i=0; i<ntargets; i=j) {
+    for(j=i+1; j<ntargets && targets[j]->parent == targets[i]->parent; j++)
+      ;
+    if(delete_group(targets+i, j-i))
+      break;
   }
+  if(marked)
+    mark_clear();
 
-  /* delete */
-  seloption = 0;
-  state = DS_PROGRESS;
-  par = root->parent;
-  delete_dir(root);
   if(nextsel)
     nextsel->flags |= FF_BSEL;
-  browse_init(par);
+  browse_init(browsedir);
   if(nextsel)
     dirlist_top(-4);
 }
@@ -247,8 +690,33 @@ void delete_process(void) {
 
 void delete_init(struct dir *dr, struct dir *s) {
   state = DS_CONFIRM;
-  root = curdir = dr;
+  ntargets = 1;
+  targets = xrealloc(targets, sizeof(*targets));
+  targets[0] = root = curdir = dr;
+  browsedir = dr->parent;
   pstate = ST_DEL;
   nextsel = s;
 }
 
+
+void delete_init_marked(struct dir *s) {
+  struct dir *p;
+
+  free(targets);
+  targets = mark_targets(&ntargets);
+  qsort(targets, ntargets, sizeof(*targets), target_cmp);
+
+  /* go back to the directory being browsed, or to the parent of the topmost
+   * marked directory it's in */
+  browsedir = dirlist_par;
+  for(p=dirlist_par; p; p=p->parent)
+    if(p->flags & FF_MARK)
+      browsedir = p->parent;
+  if(browsedir != dirlist_par || (s && (s == dirlist_parent || s->flags & FF_MARK)))
+    s = NULL;
+
+  state = DS_CONFIRM;
+  root = curdir = targets[0];
+  pstate = ST_DEL;
+  nextsel = s;
+}
@@ -35,5 +35,9 @@ int  delete_key(int);
 void delete_draw(void);
 void delete_init(struct dir *, struct dir *);
 
+/* Deletes all marked items, the given item is selected afterwards if it's
+ * still there */
+void delete_init_marked(struct dir *);
+
 
 #endif
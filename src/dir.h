@@ -81,6 +81,14 @@ struct dir_output {
    */
   int (*final)(int);
 
+  /* Set by outputs that can take the contents of directories out of order,
+   * NULL otherwise. defer() may be called right after item() opened a
+   * directory, instead of giving its contents and item(NULL), and returns a
+   * reference to the directory. Its contents follow later with resume(),
+   * which adds the given flags (FF_ERR) to it, and end with item(NULL). */
+  struct dir *(*defer)(void);
+  void (*resume)(struct dir *, int);
+
   /* The output code is responsible for updating these stats. Can be 0 when not
    * available. */
   int64_t size;
@@ -98,6 +106,10 @@ struct dir_output {
  */
 void dir_mem_init(struct dir *);
 
+/* Set while dir_mem.c is building a new tree that can already be browsed.
+ * Directories that haven't been completely scanned yet have FF_SCAN set. */
+extern int dir_mem_live;
+
 /* Initializes the SCAN state and dir_output for exporting to a file. */
 int dir_export_init(const char *fn);
 
@@ -110,6 +122,37 @@ extern int dir_scan_smfs;
 extern int exclude_kernfs;
 void dir_scan_init(const char *path);
 
+/* Scans the directory of an already scanned item, given to dir_mem_init()
+ * before, and reuses the entries of directories that haven't been modified
+ * since then */
+void dir_scan_refresh(struct dir *orig);
+
+/* Like dir_scan_refresh(), but only reads the given directory itself again
+ * and keeps the old entries of all its subdirectories, which are watched for
+ * changes separately. Fatal errors aren't waited on. */
+void dir_scan_watch(struct dir *orig);
+
+/* Number of directories whose entries were reused or read from disk, and the
+ * number of reused items, during the last scan */
+extern long dir_scan_reused_dirs, dir_scan_read_dirs, dir_scan_reused_items;
+
+/* Two-pass scanning. The first pass is a scan that only calls lstat() on
+ * directories and on files whose type readdir() doesn't tell, so that the
+ * structure of the tree can be browsed quickly. The other files are given to
+ * item() with ino 0 and no size, which dir_mem.c fills in later with
+ * dir_mem_fill() from a second pass that runs in worker threads. Only used
+ * for the first scan of a tree, the flag is cleared when the second pass
+ * starts. */
+extern int dir_scan_twopass;
+void dir_sizes_begin(void);
+void dir_sizes_init(struct dir *root);
+void dir_mem_fill(struct dir *, struct dir *, struct dir_ext *);
+
+/* Writes the progress of the second pass to buf, or an empty string if it's
+ * not running */
+void dir_sizes_status(char *buf, int len);
+void dir_sizes_stats_print(void);
+
 /* Importing a file */
 extern int dir_import_active;
 int dir_import_init(const char *fn);
@@ -166,6 +166,42 @@ static void draw_progress(void) {
 }
 
 
+/* Progress on the bottom line, used instead of the progress window while the
+ * tree is being browsed */
+static void draw_status(void) {
+  char sizes[128];
+  int x;
+
+  browse_damage(winrows-1, 1);
+  uic_set(UIC_HD);
+  mvhline(winrows-1, 0, ' ', wincols);
+  mvaddstr(winrows-1, 1, lasterr ? "Scanning (with errors)... " : "Scanning... ");
+  uic_set(UIC_NUM_HD);
+  printw("%d", dir_output.items);
+  addstrc(UIC_HD, " items");
+  if(dir_output.size) {
+    addstrc(UIC_HD, ", ");
+    printsize(UIC_HD, dir_output.size);
+  }
+
+  dir_sizes_status(sizes, sizeof(sizes));
+  x = getcurx(stdscr) + 2;
+  if(wincols-x-20 > 10)
+    mvaddstrc(UIC_HD, winrows-1, x, cropstr(*sizes ? sizes : dir_curpath, wincols-x-20));
+
+  if(confirm_quit_while_scanning_stage_1_passed) {
+    mvaddstrc(UIC_HD, winrows-1, wincols-18, "Press ");
+    addchc(UIC_KEY_HD, 'y');
+    addstrc(UIC_HD, " to abort");
+  } else {
+    mvaddstrc(UIC_HD, winrows-1, wincols-18, "Press ");
+    addchc(UIC_KEY_HD, 'q');
+    addstrc(UIC_HD, " to abort");
+  }
+  uic_set(UIC_DEFAULT);
+}
+
+
 static void draw_error(char *cur, char *msg) {
   int width = wincols-5;
   nccreate(7, width, "Error!");
@@ -181,6 +217,7 @@ static void draw_error(char *cur, char *msg) {
 
 
 void dir_draw(void) {
+  char sizes[128];
   float f;
   const char *unit;
 
@@ -190,8 +227,11 @@ void dir_draw(void) {
       fprintf(stderr, "%s.\n", dir_fatalerr);
     break;
   case 1:
+    dir_sizes_status(sizes, sizeof(sizes));
     if(dir_fatalerr)
       fprintf(stderr, "\r%s.\n", dir_fatalerr);
+    else if(*sizes)
+      fprintf(stderr, "\r%-79s", sizes);
     else if(dir_output.size) {
       f = formatsize(dir_output.size, &unit);
       fprintf(stderr, "\r%-55s %8d files /%5.1f %s",
@@ -203,6 +243,8 @@ void dir_draw(void) {
     browse_draw();
     if(dir_fatalerr)
       draw_error(dir_curpath, dir_fatalerr);
+    else if(dir_mem_live)
+      draw_status();
     else
       draw_progress();
     break;
@@ -210,6 +252,23 @@ void dir_draw(void) {
 }
 
 
+/* Keys of the browser that only move around or change the view, which can be
+ * used on the partial tree of a live scan. Anything else, such as delete,
+ * refresh or a different screen, would leave the scanning state. */
+static int live_key(int ch) {
+  switch(ch) {
+  case KEY_UP: case 'k': case KEY_DOWN: case 'j':
+  case KEY_HOME: case KEY_LL: case KEY_END: case KEY_PPAGE: case KEY_NPAGE:
+  case 10: case KEY_RIGHT: case 'l': case KEY_LEFT: case KEY_BACKSPACE: case 'h': case '<':
+  case 'n': case 's': case 'C': case 'M': case 'e': case 't': case 'a':
+  case 'g': case 'c': case 'm': case 'i': case '1': case '2':
+  case ' ': case 'x':
+    return 1;
+  }
+  return 0;
+}
+
+
 /* This function can't be called unless dir_ui == 2
  * (Doesn't really matter either way). */
 int dir_key(int ch) {
@@ -229,5 +288,8 @@ int dir_key(int ch) {
     } else
       return 1;
   }
+  /* Browse the partial tree */
+  if(dir_mem_live && live_key(ch))
+    return browse_key(ch);
   return 0;
 }
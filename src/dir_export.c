@@ -33,6 +33,10 @@
 
 static FILE *stream;
 
+/* Writes that take longer than this (in ns) are in the --trace output. Most
+ * only fill the stdio buffer, the slow ones are when it is written out. */
+#define TRACE_MIN_WRITE 10000
+
 /* Stack of device IDs, also used to keep track of the level of nesting */
 static struct stack {
   uint64_t *list;
@@ -140,23 +144,86 @@ static void output_info(struct dir *d, const char *name, struct dir_ext *e, unsi
 }
 
 
+/* Metadata that is only known after the scan, written after the root item */
+static void output_top(void) {
+  static const char *names[2] = { "largest_files", "largest_dirs" };
+  struct top_entry *l;
+  int list, i, len;
+
+  for(list=0; list<2; list++) {
+    l = top_sorted(list, &len);
+    fprintf(stream, "%s\"%s\":[", list ? "," : "", names[list]);
+    for(i=0; i<len; i++) {
+      fputs(i ? ",{\"path\":\"" : "{\"path\":\"", stream);
+      output_string(l[i].path);
+      fputs("\",\"dsize\":", stream);
+      output_int((uint64_t)l[i].size);
+      fputc('}', stream);
+    }
+    fputc(']', stream);
+    free(l);
+  }
+}
+
+
+static void output_agg(void) {
+  static const char *names[AGG_TABLES] = { "usage_by_ext", "usage_by_uid", "usage_by_gid", "usage_by_age" };
+  struct agg_row *l;
+  int t, i, len;
+
+  for(t=0; t<AGG_TABLES; t++) {
+    l = agg_sorted(t, &len);
+    fprintf(stream, ",\"%s\":[", names[t]);
+    for(i=0; i<len; i++) {
+      fputs(i ? ",{\"name\":\"" : "{\"name\":\"", stream);
+      output_string(l[i].name);
+      fputc('"', stream);
+      if(l[i].id >= 0) {
+        fputs(t == AGG_UID ? ",\"uid\":" : ",\"gid\":", stream);
+        output_int((uint64_t)l[i].id);
+      }
+      fputs(",\"asize\":", stream);
+      output_int((uint64_t)l[i].asize);
+      fputs(",\"dsize\":", stream);
+      output_int((uint64_t)l[i].size);
+      fputs(",\"items\":", stream);
+      output_int((uint64_t)l[i].items);
+      fputc('}', stream);
+    }
+    fputc(']', stream);
+    free(l);
+  }
+}
+
+
 /* Note on error handling: For convenience, we just keep writing to *stream
  * without checking the return values of the functions. Only at the and of each
  * item() call do we check for ferror(). This greatly simplifies the code, but
  * assumes that calls to fwrite()/fput./etc don't do any weird stuff when
  * called with a stream that's in an error state. */
 static int item(struct dir *item, const char *name, struct dir_ext *ext, unsigned int nlink) {
+  uint64_t t, tr = trace_begin();
+  int r;
+
   if(!item) {
+    top_leave();
     nstack_pop(&stack);
     if(!stack.top) { /* closing of the root item */
-      fputs("]]", stream);
-      return fclose(stream);
+      fputs("],\n{", stream);
+      output_top();
+      output_agg();
+      fputs("}]", stream);
+      tr = trace_begin();
+      r = fclose(stream);
+      trace_span("export flush", tr, NULL, -1);
+      return r;
     } else /* closing of a regular directory item */
       fputs("]", stream);
     return ferror(stream);
   }
 
   dir_output.items++;
+  t = stats_begin(STAT_EXPORT);
 
   /* File header.
    * TODO: Add scan options? */
@@ -174,6 +241,11 @@ static int item(struct dir *item, const char *name, struct dir_ext *ext, unsigne
 
   if(item->flags & FF_DIR)
     nstack_push(&stack, item->dev);
+  stats_end(STAT_EXPORT, t);
+  if(tr && stats_now() - tr > TRACE_MIN_WRITE)
+    trace_span("export write", tr, NULL, -1);
+  top_item(item, NULL);
+  agg_item(item, name, ext);
 
   return ferror(stream);
 }
@@ -192,10 +264,13 @@ int dir_export_init(const char *fn) {
     return 1;
 
   nstack_init(&stack);
+  top_reset();
+  agg_reset();
 
   pstate = ST_CALC;
   dir_output.item = item;
   dir_output.final = final;
+  dir_output.defer = NULL;
   dir_output.size = 0;
   dir_output.items = 0;
   return 0;
@@ -86,6 +86,7 @@ static struct ctx {
  * Returns 0 on success, non-zero on error. */
 static int fill(int n) {
   int r;
+  uint64_t t;
 
   if(ctx->eof)
     return 0;
@@ -102,7 +103,9 @@ static int fill(int n) {
   }
 
   do {
+    t = trace_begin();
     r = fread(ctx->lastfill, 1, n, ctx->stream);
+    trace_span("import read", t, NULL, r);
     if(r != n) {
       if(feof(ctx->stream))
         ctx->eof = 1;
@@ -615,6 +618,7 @@ static int footer(void) {
 static int process(void) {
   int fail = 0;
 
+  stats_phase(PH_IMPORT);
   header();
 
   if(!dir_fatalerr)
@@ -35,12 +35,28 @@ static struct dir *root;   /* root directory struct we're scanning */
 static struct dir *curdir; /* directory item that we're currently adding items to */
 static struct dir *orig;   /* original directory, when refreshing an already scanned dir */
 
+int dir_mem_live = 0;
+
 /* Table of struct dir items with more than one link (in order to detect hard links) */
 #define hlink_hash(d)     (kh_hash_uint64((khint64_t)d->dev) ^ kh_hash_uint64((khint64_t)d->ino))
 #define hlink_equal(a, b) ((a)->dev == (b)->dev && (a)->ino == (b)->ino)
 KHASHL_SET_INIT(KH_LOCAL, hl_t, hl, struct dir *, hlink_hash, hlink_equal)
 static hl_t *links = NULL;
 
+/* Directories that are incomplete because the contents of some of them were
+ * deferred, with the number of things they're waiting for: their own
+ * contents, and the deferred directories below them. */
+struct pending {
+  int left;
+  int deferred; /* whether the contents of the directory itself came later */
+};
+#define pending_hash(d) kh_hash_uint64((khint64_t)(uintptr_t)(d))
+KHASHL_MAP_INIT(KH_LOCAL, pd_t, pd, struct dir *, struct pending, pending_hash, kh_eq_generic)
+static pd_t *pending = NULL;
+
+/* Items added since the last check whether a checkpoint is due */
+static int since_checkpoint;
+
 
 /* recursively checks a dir structure for hard links and fills the lookup array */
 static void hlink_init(struct dir *d) {
@@ -61,6 +77,7 @@ static void hlink_init(struct dir *d) {
 static void hlink_check(struct dir *d) {
   struct dir *t, *pt, *par;
   int i;
+  uint64_t ts = stats_begin(STAT_HLINK);
 
   /* add to links table */
   khint_t k = hl_put(links, d, &i);
@@ -87,6 +104,76 @@ static void hlink_check(struct dir *d) {
       par->asize = adds64(par->asize, d->asize);
     }
   }
+  stats_end(STAT_HLINK, ts);
+}
+
+
+/* Called when one of the things a directory was waiting for is done, clears
+ * FF_SCAN when it was the last */
+static void dir_done(struct dir *d) {
+  khint_t k;
+  int deferred;
+
+  while(d) {
+    if(!pending || (k = pd_get(pending, d)) == kh_end(pending)) {
+      d->flags &= ~FF_SCAN;
+      return;
+    }
+    if(--kh_val(pending, k).left > 0)
+      return;
+    deferred = kh_val(pending, k).deferred;
+    pd_del(pending, k);
+    d->flags &= ~FF_SCAN;
+    /* the parent waited for it */
+    if(!deferred)
+      return;
+    d = d->parent;
+  }
+}
+
+
+static struct dir *defer(void) {
+  struct dir *d = curdir;
+  khint_t k;
+  int absent;
+
+  if(!pending)
+    pending = pd_init();
+  k = pd_put(pending, d, &absent);
+  kh_val(pending, k).left = 1;
+  kh_val(pending, k).deferred = 1;
+
+  /* the parent's own contents are being read right now */
+  k = pd_put(pending, d->parent, &absent);
+  if(absent) {
+    kh_val(pending, k).left = 1;
+    kh_val(pending, k).deferred = 0;
+  }
+  kh_val(pending, k).left++;
+
+  top_skip();
+  curdir = d->parent;
+  return d;
+}
+
+
+static void resume(struct dir *d, int flags) {
+  struct dir *t;
+
+  curdir = d;
+  d->flags |= flags;
+  if(flags & FF_ERR)
+    for(t=d->parent; t; t=t->parent)
+      t->flags |= FF_SERR;
+  top_item(d, d);
+}
+
+
+static void checkpoint(void) {
+  if(resume_file && !orig && ++since_checkpoint >= 1024) {
+    since_checkpoint = 0;
+    cache_checkpoint(root, 0);
+  }
 }
 
 
@@ -115,13 +202,17 @@ static int item(struct dir *dir, const char *name, struct dir_ext *ext, unsigned
 
   /* Go back to parent dir */
   if(!dir) {
+    top_leave();
+    t = curdir;
     curdir = curdir->parent;
+    dir_done(t);
     return 0;
   }
 
   if(!root && orig)
     name = orig->name;
 
+  agg_item(dir, name, ext);
   if(!extended_info)
     dir->flags &= ~FF_EXT;
   item = xmalloc(dir->flags & FF_EXT ? dir_ext_memsize(name) : dir_memsize(name));
@@ -130,17 +221,39 @@ static int item(struct dir *dir, const char *name, struct dir_ext *ext, unsigned
   if(item->flags & FF_EXT)
     memcpy(dir_ext_ptr(item), ext, sizeof(struct dir_ext));
 
+  /* determine once whether the browser may hide this item */
+  item->flags &= ~FF_HIDN;
+  if(item->flags & FF_EXL || name[0] == '.' || (*name && name[strlen(name)-1] == '~'))
+    item->flags |= FF_HIDN;
+
   item_add(item);
+  top_item(item, item);
 
   /* Ensure that any next items will go to this directory */
-  if(item->flags & FF_DIR)
+  if(item->flags & FF_DIR) {
+    if(stamp_cur.mtime || stamp_cur.ctime)
+      stamp_put(item, &stamp_cur);
     curdir = item;
+    /* checkpoints need to know which directories aren't complete */
+    if(dir_mem_live || (resume_file && !orig))
+      item->flags |= FF_SCAN;
+  }
 
   /* Special-case the name of the root item to be empty instead of "/". This is
    * what getpath() expects. */
   if(item == root && strcmp(item->name, "/") == 0)
     item->name[0] = 0;
 
+  /* A new scan with the full ncurses UI can be browsed while it's running */
+  if(item == root && !orig && dir_ui == 2) {
+    dir_mem_live = 1;
+    root->flags |= FF_SCAN;
+    dirlist_open(root);
+    /* the scanner can then read the browsed directory first */
+    dir_output.defer = defer;
+    dir_output.resume = resume;
+  }
+
   /* Update stats of parents. Don't update the size/asize fields if this is a
    * possible hard link, because hlnk_check() will take care of it in that
    * case. */
@@ -161,15 +274,35 @@ static int item(struct dir *dir, const char *name, struct dir_ext *ext, unsigned
   dir_output.size = root->size;
   dir_output.items = root->items;
 
+  checkpoint();
   return 0;
 }
 
 
 static int final(int fail) {
+  int live = dir_mem_live;
+
+  /* The structure is there, the sizes of the files come next. The hard link
+   * table and live browsing stay. */
+  if(!fail && !orig && dir_scan_twopass) {
+    dir_scan_twopass = 0;
+    dir_output.defer = NULL;
+    dir_sizes_init(root);
+    return 0;
+  }
+
   hl_destroy(links);
   links = NULL;
+  if(pending)
+    pd_destroy(pending);
+  pending = NULL;
+  dir_mem_live = 0;
+  dir_output.defer = NULL;
 
   if(fail) {
+    /* the scan can continue from here with --resume */
+    if(resume_file && !orig && root)
+      cache_checkpoint(root, 1);
     freedir(root);
     if(orig) {
       browse_init(orig);
@@ -178,6 +311,8 @@ static int final(int fail) {
       return 1;
   }
 
+  stats_phase(PH_BROWSE);
+
   /* success, update references and free original item */
   if(orig) {
     root->next = orig->next;
@@ -192,19 +327,72 @@ static int final(int fail) {
     freedir(orig);
   }
 
-  browse_init(root);
-  dirlist_top(-3);
+  if(cache_file)
+    cache_save(getroot(root));
+  if(!orig)
+    cache_resume_done();
+
+  /* stay where the user was browsing the partial tree */
+  if(live && dirlist_par)
+    browse_init(dirlist_par);
+  else {
+    browse_init(root);
+    dirlist_top(-3);
+  }
+  /* this includes the listing of the backups that ncdu starts with */
+  if(!orig)
+    trash_check(root);
   return 0;
 }
 
 
+void dir_mem_fill(struct dir *d, struct dir *item, struct dir_ext *ext) {
+  struct dir *t;
+  struct dir_ext *e;
+
+  d->ino = item->ino;
+  d->dev = item->dev;
+  d->size = item->size;
+  d->asize = item->asize;
+  d->flags = (d->flags & ~FF_FILE) | (item->flags & (FF_FILE|FF_ERR|FF_OTHFS|FF_HLNKC));
+  if((e = dir_ext_ptr(d)) != NULL)
+    memcpy(e, ext, sizeof(struct dir_ext));
+
+  if(d->flags & FF_ERR)
+    for(t=d->parent; t; t=t->parent)
+      t->flags |= FF_SERR;
+
+  if(d->flags & FF_HLNKC)
+    hlink_check(d);
+  else
+    addparentstats(d->parent, d->size, d->asize, ext->mtime, 0);
+
+  if(d->flags & FF_TOP)
+    top_forget(d);
+  top_item(d, d);
+  dir_output.size = root->size;
+  checkpoint();
+}
+
+
 void dir_mem_init(struct dir *_orig) {
   orig = _orig;
   root = curdir = NULL;
+  dir_mem_live = 0;
+  since_checkpoint = 0;
+  if(orig) {
+    top_forget_below(orig);
+    agg_invalidate();
+  } else {
+    top_reset();
+    agg_reset();
+    stamp_reset();
+  }
   pstate = ST_CALC;
 
   dir_output.item = item;
   dir_output.final = final;
+  dir_output.defer = NULL;
   dir_output.size = 0;
   dir_output.items = 0;
 
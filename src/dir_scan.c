@@ -34,6 +34,8 @@
 #include <sys/stat.h>
 #include <dirent.h>
 
+#include <khashl.h>
+
 #if HAVE_SYS_ATTR_H && HAVE_GETATTRLIST && HAVE_DECL_ATTR_CMNEXT_NOFIRMLINKPATH
 #include <sys/attr.h>
 #endif
@@ -52,6 +54,9 @@
 
 int dir_scan_smfs; /* Stay on the same filesystem */
 int exclude_kernfs; /* Exclude Linux pseudo filesystems */
+int dir_scan_twopass; /* Leave the lstat() of files to dir_sizes.c */
+
+long dir_scan_reused_dirs, dir_scan_read_dirs, dir_scan_reused_items;
 
 static uint64_t curdev;   /* current device we're scanning on */
 
@@ -60,6 +65,40 @@ static struct dir    *buf_dir;
 static struct dir_ext buf_ext[1];
 static unsigned int buf_nlink;
 
+/* Incremental refresh. The old tree stays in memory until the scan is done,
+ * and a directory with the same stamp as its old version still has the same
+ * entries. Those entries are passed on from the old tree without reading the
+ * directory or calling lstat() on its files, only subdirectories and items
+ * that had an error are scanned again. */
+static struct dir *refresh_orig; /* old tree, NULL for a full scan */
+static struct dir *olddir;       /* old version of the current directory */
+static struct dir *olditem;      /* old version of the item to be scanned */
+static unsigned char itemtype;   /* d_type of the item to be scanned */
+static int refresh_shallow;      /* only read the top directory again */
+
+/* Directories whose contents are read later, when the output can take them
+ * out of order. The last one is read first, which keeps the order close to
+ * that of a recursive scan, except for the directories below the one that is
+ * being browsed (the focus): those go in a separate stack that comes first. */
+struct work {
+  struct dir *node, *old;
+  uint64_t dev;
+  int reuse;
+  char path[FLEXIBLE_ARRAY_MEMBER];
+};
+static struct work **todo, **front;
+static int todo_len, todo_size, front_len, front_size;
+static struct dir *focus, *browsed;
+static char *workdir; /* directory we're chdir'ed to, NULL if not known */
+
+/* Whether this scan is the first pass of a two-pass scan. Only a new scan into
+ * memory has a second pass, see final() in dir_mem.c; --two-pass is turned
+ * off for exports. */
+static int twopass;
+
+/* Subdirectories of olddir by name, while walking a directory that changed */
+KHASHL_MAP_INIT(KH_LOCAL, od_t, od, const char *, struct dir *, kh_hash_str, kh_eq_str)
+
 
 #if HAVE_LINUX_MAGIC_H && HAVE_SYS_STATFS_H && HAVE_STATFS
 
@@ -118,8 +157,10 @@ static void stat_to_dir(struct stat *fs) {
 
   if(S_ISREG(fs->st_mode))
     buf_dir->flags |= FF_FILE;
-  else if(S_ISDIR(fs->st_mode))
+  else if(S_ISDIR(fs->st_mode)) {
     buf_dir->flags |= FF_DIR;
+    stamp_from_stat(&stamp_cur, fs);
+  }
 
   if(!S_ISDIR(fs->st_mode) && fs->st_nlink > 1) {
     buf_dir->flags |= FF_HLNKC;
@@ -144,8 +185,9 @@ static void stat_to_dir(struct stat *fs) {
 
 
 /* Reads all filenames in the currently chdir'ed directory and stores it as a
- * nul-separated list of filenames. The list ends with an empty filename (i.e.
- * two nuls). . and .. are not included. Returned memory should be freed. *err
+ * nul-separated list of filenames, each followed by its d_type (or 0 when
+ * that's not known). The list ends with an empty filename (i.e. two nuls).
+ * . and .. are not included. Returned memory should be freed. *err
  * is set to 1 if some error occurred. Returns NULL if that error was fatal.
  * The reason for reading everything in memory first and then walking through
  * the list is to avoid eating too many file descriptors in a deeply recursive
@@ -156,8 +198,13 @@ static char *dir_read(int *err) {
   char *buf = NULL;
   size_t buflen = 512;
   size_t off = 0;
+  uint64_t t, tr = trace_begin();
+  long n = 0;
 
-  if((dir = opendir(".")) == NULL) {
+  t = stats_begin(STAT_OPENDIR);
+  dir = opendir(".");
+  stats_end(STAT_OPENDIR, t);
+  if(dir == NULL) {
     *err = 1;
     return NULL;
   }
@@ -167,7 +214,10 @@ static char *dir_read(int *err) {
   while(1) {
     size_t len, req;
     errno = 0;
-    if ((item = readdir(dir)) == NULL) {
+    t = stats_begin(STAT_READDIR);
+    item = readdir(dir);
+    stats_end(STAT_READDIR, t);
+    if (item == NULL) {
       if(errno)
         *err = 1;
       break;
@@ -175,30 +225,210 @@ static char *dir_read(int *err) {
     if(item->d_name[0] == '.' && (item->d_name[1] == 0 || (item->d_name[1] == '.' && item->d_name[2] == 0)))
       continue;
     len = strlen(item->d_name);
-    req = off+3+len;
+    req = off+4+len;
     if(req > buflen) {
       buflen = req < buflen*2 ? buflen*2 : req;
       buf = xrealloc(buf, buflen);
     }
     strcpy(buf+off, item->d_name);
     off += len+1;
+    n++;
+#if HAVE_STRUCT_DIRENT_D_TYPE
+    buf[off++] = item->d_type;
+#else
+    buf[off++] = 0;
+#endif
   }
   if(closedir(dir) < 0)
     *err = 1;
 
   buf[off] = 0;
   buf[off+1] = 0;
+  if(tr)
+    trace_span("readdir", tr, dir_curpath, n);
   return buf;
 }
 
 
 static int dir_walk(char *);
+static int dir_reuse(struct dir *);
+
+
+/* Whether old is a readable old version of the directory in buf_dir */
+static int dir_same(struct dir *old) {
+  return old && old->flags & FF_DIR && !(old->flags & FF_ERR)
+    && old->dev == buf_dir->dev && old->ino == buf_dir->ino;
+}
+
+
+/* Whether old is a directory that still has the same entries as the one in
+ * buf_dir and stamp_cur */
+static int dir_unchanged(struct dir *old) {
+  struct stamp s;
+  return dir_same(old) && stamp_get(old, &s) && s.mtime == stamp_cur.mtime && s.ctime == stamp_cur.ctime;
+}
+
+
+static int under_focus(struct dir *d) {
+  for(; focus && d; d=d->parent)
+    if(d == focus)
+      return 1;
+  return 0;
+}
+
+
+static void work_push(struct work *w) {
+  if(under_focus(w->node)) {
+    if(front_len == front_size) {
+      front_size = front_size ? front_size*2 : 64;
+      front = xrealloc(front, front_size*sizeof(*front));
+    }
+    front[front_len++] = w;
+  } else {
+    if(todo_len == todo_size) {
+      todo_size = todo_size ? todo_size*2 : 64;
+      todo = xrealloc(todo, todo_size*sizeof(*todo));
+    }
+    todo[todo_len++] = w;
+  }
+}
+
+
+/* Returns the next directory to read, or NULL when there are none left */
+static struct work *work_pop(void) {
+  struct work **all;
+  int i, n;
+
+  /* The user went somewhere else, which puts the work in front back in its
+   * place and brings the work below the new focus forward. */
+  if(dirlist_par != browsed) {
+    browsed = dirlist_par;
+    focus = dirlist_par && dirlist_par->parent ? dirlist_par : NULL;
+    n = todo_len + front_len;
+    all = xmalloc((n+1)*sizeof(*all));
+    memcpy(all, todo, todo_len*sizeof(*all));
+    memcpy(all+todo_len, front, front_len*sizeof(*all));
+    todo_len = front_len = 0;
+    for(i=0; i<n; i++)
+      work_push(all[i]);
+    free(all);
+  }
+  if(front_len)
+    return front[--front_len];
+  return todo_len ? todo[--todo_len] : NULL;
+}
+
+
+/* Hands the current directory item (buf_dir) to the output and leaves its
+ * contents for later */
+static int dir_scan_defer(const char *name, struct dir *old) {
+  struct work *w;
+  struct dir *node;
+
+  if(dir_output.item(buf_dir, name, buf_ext, buf_nlink)) {
+    dir_seterr("Output error: %s", strerror(errno));
+    return 1;
+  }
+  node = dir_output.defer();
+  w = xmalloc(offsetof(struct work, path) + strlen(dir_curpath) + 1);
+  w->node = node;
+  w->old = old;
+  w->dev = buf_dir->dev;
+  w->reuse = dir_unchanged(old);
+  strcpy(w->path, dir_curpath);
+  work_push(w);
+  return 0;
+}
 
 
-/* Tries to recurse into the current directory item (buf_dir is assumed to be the current dir) */
-static int dir_scan_recurse(const char *name) {
+/* Changes to the absolute path of a deferred directory with a single chdir()
+ * relative to the last one, which is usually its parent or a sibling. Only
+ * when that fails does it go down from the root one component at a time. */
+static int work_chdir(const char *path) {
+  char *rel, *r;
+  const char *p;
+  int i = 0, j, up = 0, res = -1;
+
+  if(workdir) {
+    /* i = end of the last path component that both have in common */
+    for(j=0; workdir[j] && workdir[j] == path[j]; j++)
+      if(workdir[j] == '/')
+        i = j;
+    if((!workdir[j] && (!path[j] || path[j] == '/')) || (!path[j] && workdir[j] == '/'))
+      i = j;
+    for(p=workdir+i; *p; p++)
+      if(*p == '/' && p[1] && p[1] != '/')
+        up++;
+    for(p=path+i; *p == '/'; p++)
+      ;
+    r = rel = xmalloc(up*3 + strlen(p) + 2);
+    while(up-- > 0) {
+      strcpy(r, "../");
+      r += 3;
+    }
+    strcpy(r, p);
+    if(!*rel)
+      strcpy(rel, ".");
+    res = chdir(rel);
+    free(rel);
+  }
+
+  free(workdir);
+  workdir = NULL;
+  if(res < 0 && path_chdir(path) < 0)
+    return -1;
+  workdir = xstrdup(path);
+  return 0;
+}
+
+
+/* Reads the contents of a deferred directory */
+static int dir_scan_work(struct work *w) {
   int fail = 0;
-  char *dir;
+  char *dir = NULL;
+
+  dir_curpath_set(w->path);
+  if(work_chdir(w->path) < 0) {
+    dir_setlasterr(dir_curpath);
+    dir_output.resume(w->node, FF_ERR);
+    goto done;
+  }
+  watch_dir(dir_curpath, w->dev);
+  if(w->reuse)
+    dir_scan_reused_dirs++;
+  else
+    dir_scan_read_dirs++;
+  if(!w->reuse && (dir = dir_read(&fail)) == NULL) {
+    dir_setlasterr(dir_curpath);
+    dir_output.resume(w->node, FF_ERR);
+    goto done;
+  }
+
+  dir_output.resume(w->node, fail ? FF_ERR : 0);
+  olddir = w->old;
+  fail = w->reuse ? dir_reuse(w->old) : dir_walk(dir);
+  olddir = NULL;
+  if(fail)
+    return 1;
+
+done:
+  if(dir_output.item(NULL, 0, NULL, 0)) {
+    dir_seterr("Output error: %s", strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+
+/* Tries to recurse into the current directory item (buf_dir is assumed to be
+ * the current dir), old is its version in the old tree or NULL */
+static int dir_scan_recurse(const char *name, struct dir *old) {
+  int fail = 0, reuse;
+  char *dir = NULL;
+  struct dir *prev;
+
+  if(dir_output.defer)
+    return dir_scan_defer(name, old);
 
   if(chdir(name)) {
     dir_setlasterr(dir_curpath);
@@ -210,7 +440,21 @@ static int dir_scan_recurse(const char *name) {
     return 0;
   }
 
-  if((dir = dir_read(&fail)) == NULL) {
+  reuse = dir_unchanged(old);
+  /* A shallow refresh trusts the old entries of every subdirectory. They keep
+   * their old stamp, so that another refresh still checks them. */
+  if(!reuse && refresh_shallow && dir_same(old)) {
+    reuse = 1;
+    if(!stamp_get(old, &stamp_cur))
+      memset(&stamp_cur, 0, sizeof(stamp_cur));
+  }
+  if(!reuse || !refresh_shallow)
+    watch_dir(dir_curpath, buf_dir->dev);
+  if(reuse)
+    dir_scan_reused_dirs++;
+  else
+    dir_scan_read_dirs++;
+  if(!reuse && (dir = dir_read(&fail)) == NULL) {
     dir_setlasterr(dir_curpath);
     buf_dir->flags |= FF_ERR;
     if(dir_output.item(buf_dir, name, buf_ext, buf_nlink) || dir_output.item(NULL, 0, NULL, 0)) {
@@ -232,8 +476,12 @@ static int dir_scan_recurse(const char *name) {
     dir_seterr("Output error: %s", strerror(errno));
     return 1;
   }
-  fail = dir_walk(dir);
-  if(dir_output.item(NULL, 0, NULL, 0)) {
+  prev = olddir;
+  olddir = old;
+  fail = reuse ? dir_reuse(old) : dir_walk(dir);
+  olddir = prev;
+  /* an aborted directory isn't complete, see cache_checkpoint() */
+  if(!fail && dir_output.item(NULL, 0, NULL, 0)) {
     dir_seterr("Output error: %s", strerror(errno));
     return 1;
   }
@@ -253,7 +501,13 @@ static int dir_scan_recurse(const char *name) {
  * resides. */
 static int dir_scan_item(const char *name) {
   static struct stat st, stl;
-  int fail = 0;
+  struct dir *old = olditem;
+  int fail = 0, type = itemtype;
+  uint64_t t;
+
+  olditem = NULL;
+  itemtype = 0;
+  memset(&stamp_cur, 0, sizeof(stamp_cur));
 
 #ifdef __CYGWIN__
   /* /proc/registry names may contain slashes */
@@ -263,18 +517,50 @@ static int dir_scan_item(const char *name) {
   }
 #endif
 
+  /* what's in our own trash is already gone from the tree */
+  if(strcmp(name, TRASH_NAME) == 0 && trash_ignored(dir_curpath))
+    return input_handle(1);
+
+  t = stats_begin(STAT_EXCLUDE);
   if(exclude_match(dir_curpath))
     buf_dir->flags |= FF_EXL;
+  stats_end(STAT_EXCLUDE, t);
+
+#if HAVE_STRUCT_DIRENT_D_TYPE
+  /* The first pass of a two-pass scan only looks at directories. Files that
+   * readdir() knew the type of are passed on as they are, with ino 0. */
+  if(twopass && !(buf_dir->flags & (FF_ERR|FF_EXL)) && type != DT_UNKNOWN
+      && type != DT_DIR && !(follow_symlinks && type == DT_LNK)) {
+    buf_dir->flags |= FF_EXT | (type == DT_REG ? FF_FILE : 0);
+    if(dir_output.item(buf_dir, name, buf_ext, 0)) {
+      dir_seterr("Output error: %s", strerror(errno));
+      fail = 1;
+    }
+    return fail || input_handle(1);
+  }
+#else
+  (void)type;
+#endif
 
-  if(!(buf_dir->flags & (FF_ERR|FF_EXL)) && lstat(name, &st)) {
-    buf_dir->flags |= FF_ERR;
-    dir_setlasterr(dir_curpath);
+  if(!(buf_dir->flags & (FF_ERR|FF_EXL))) {
+    int r;
+    t = stats_begin(STAT_LSTAT);
+    r = lstat(name, &st);
+    stats_end(STAT_LSTAT, t);
+    if(r) {
+      buf_dir->flags |= FF_ERR;
+      dir_setlasterr(dir_curpath);
+    }
   }
 
 #if HAVE_LINUX_MAGIC_H && HAVE_SYS_STATFS_H && HAVE_STATFS
   if(exclude_kernfs && !(buf_dir->flags & (FF_ERR|FF_EXL)) && S_ISDIR(st.st_mode)) {
     struct statfs fst;
-    if(statfs(name, &fst)) {
+    int r;
+    t = stats_begin(STAT_STATFS);
+    r = statfs(name, &fst);
+    stats_end(STAT_STATFS, t);
+    if(r) {
       buf_dir->flags |= FF_ERR;
       dir_setlasterr(dir_curpath);
     } else if(is_kernfs(fst.f_type))
@@ -302,7 +588,13 @@ static int dir_scan_item(const char *name) {
 #endif
 
   if(!(buf_dir->flags & (FF_ERR|FF_EXL))) {
-    if(follow_symlinks && S_ISLNK(st.st_mode) && !stat(name, &stl) && !S_ISDIR(stl.st_mode))
+    int r = -1;
+    if(follow_symlinks && S_ISLNK(st.st_mode)) {
+      t = stats_begin(STAT_STAT);
+      r = stat(name, &stl);
+      stats_end(STAT_STAT, t);
+    }
+    if(!r && !S_ISDIR(stl.st_mode))
       stat_to_dir(&stl);
     else
       stat_to_dir(&st);
@@ -316,7 +608,7 @@ static int dir_scan_item(const char *name) {
 
   /* Recurse into the dir or output the item */
   if(buf_dir->flags & FF_DIR && !(buf_dir->flags & (FF_ERR|FF_EXL|FF_OTHFS|FF_KERNFS|FF_FRMLNK)))
-    fail = dir_scan_recurse(name);
+    fail = dir_scan_recurse(name, old);
   else if(buf_dir->flags & FF_DIR) {
     if(dir_output.item(buf_dir, name, buf_ext, 0) || dir_output.item(NULL, 0, NULL, 0)) {
       dir_seterr("Output error: %s", strerror(errno));
@@ -335,29 +627,93 @@ static int dir_scan_item(const char *name) {
  * the filenames as returned by dir_read(), and will be freed automatically by
  * this function. */
 static int dir_walk(char *dir) {
-  int fail = 0;
+  struct dir *c;
+  od_t *old = NULL;
+  khint_t k;
+  int fail = 0, absent;
   char *cur;
+  uint64_t t = trace_begin();
+  long n = 0;
+
+  if(olddir) {
+    old = od_init();
+    for(c=olddir->sub; c; c=c->next)
+      if(c->flags & FF_DIR) {
+        k = od_put(old, c->name, &absent);
+        kh_val(old, k) = c;
+      }
+  }
 
   fail = 0;
-  for(cur=dir; !fail&&cur&&*cur; cur+=strlen(cur)+1) {
+  for(cur=dir; !fail&&cur&&*cur; cur+=strlen(cur)+2) {
     dir_curpath_enter(cur);
     memset(buf_dir, 0, offsetof(struct dir, name));
     memset(buf_ext, 0, sizeof(struct dir_ext));
     buf_nlink = 0;
+    if(old && (k = od_get(old, cur)) != kh_end(old))
+      olditem = kh_val(old, k);
+    itemtype = cur[strlen(cur)+1];
     fail = dir_scan_item(cur);
     dir_curpath_leave();
+    n++;
   }
 
+  if(old)
+    od_destroy(old);
   free(dir);
+  if(t)
+    trace_span("scan", t, dir_curpath, n);
+  return fail;
+}
+
+
+/* Passes on the entries of an unchanged directory from the old tree. The
+ * nlink of hard links isn't known here, but that is only used by the export,
+ * which doesn't refresh. */
+static int dir_reuse(struct dir *old) {
+  struct dir *c;
+  struct dir_ext *e;
+  int fail = 0;
+
+  for(c=old->sub; !fail && c; c=c->next) {
+    dir_curpath_enter(c->name);
+    memset(buf_dir, 0, offsetof(struct dir, name));
+    memset(buf_ext, 0, sizeof(struct dir_ext));
+    buf_nlink = 0;
+    if(c->flags & (FF_DIR|FF_ERR)) {
+      olditem = c;
+      fail = dir_scan_item(c->name);
+    } else {
+      buf_dir->size = c->size;
+      buf_dir->asize = c->asize;
+      buf_dir->ino = c->ino;
+      buf_dir->dev = c->dev;
+      buf_dir->flags = c->flags & (FF_FILE|FF_OTHFS|FF_EXL|FF_HLNKC|FF_KERNFS|FF_FRMLNK|FF_EXT);
+      if((e = dir_ext_ptr(c)) != NULL)
+        memcpy(buf_ext, e, sizeof(struct dir_ext));
+      dir_scan_reused_items++;
+      if(dir_output.item(buf_dir, c->name, buf_ext, buf_nlink)) {
+        dir_seterr("Output error: %s", strerror(errno));
+        fail = 1;
+      }
+      fail = fail || input_handle(1);
+    }
+    dir_curpath_leave();
+  }
   return fail;
 }
 
-static void listbackups(void) {
-  char *rootName = "/Volumes/.timemachine";
-  struct dir *root = xmalloc(dir_memsize(rootName));
-  // item_add
-  strcpy(root->name, rootName);
-  dir_output.item(root, rootName, buf_ext, buf_nlink);
+/* Reads the backups that tmutil listed in place of the contents of the
+ * /Volumes/.timemachine directory, in the same format as dir_read(). A backup
+ * is given by the entry of the root it's in, so that the scan can treat the
+ * listing as an ordinary directory; backups elsewhere can't be in this tree
+ * and are left out. Assumes we're chdir'ed to the root. */
+static char *listbackups(int *err) {
+  static const char root[] = "/Volumes/.timemachine/";
+  char line[LINE_MAX], *name, *c;
+  char *buf;
+  size_t buflen = 512, off = 0, len, req;
+  FILE *fp;
 
   // tmutil requires default Terminal.app, otherwise it will requires Full disk permissions
   // system("open /Volumes/Projects/tmutil");
@@ -365,75 +721,86 @@ static void listbackups(void) {
     sleep(1);
   }
 
-  FILE *fp = fopen("/Volumes/Projects/tmutil.listbackups.txt", "r");
-  if(fp == NULL) {
-    perror("tmutil failed");
-    return;
-  }
-
-  size_t buflen = 512;
-  size_t off = 0;
-  char *buf = NULL;
-
-  char stdoutstr[LINE_MAX] = {0};
-  while(fgets(stdoutstr, sizeof(stdoutstr), fp) != 0) {
-    struct dirent *item;
-    size_t len, req;
-    int32_t stdoutstrlen = strlen(stdoutstr);
-
-    // remove \n
-    if(stdoutstr[stdoutstrlen - 1] == '\n') {
-      stdoutstr[stdoutstrlen - 1] = '/';
-    }
+  if((fp = fopen("/Volumes/Projects/tmutil.listbackups.txt", "r")) == NULL)
+    return NULL;
 
-    DIR *dir = opendir(stdoutstr);
-    if((item = readdir(dir)) == NULL) {
+  buf = xmalloc(buflen);
+  while(fgets(line, sizeof(line), fp) != NULL) {
+    if(strncmp(line, root, sizeof(root)-1) != 0)
       continue;
-    }
-    if(item->d_name[0] == '.' && (item->d_name[1] == 0 || (item->d_name[1] == '.' && item->d_name[2] == 0))) {
+    name = line + sizeof(root)-1;
+    name[strcspn(name, "/\n")] = 0;
+    if(!*name || (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))))
+      continue;
+    /* several backups are usually in the same entry */
+    for(c=buf; c<buf+off && strcmp(c, name) != 0; c+=strlen(c)+2)
+      ;
+    if(c < buf+off)
       continue;
+    len = strlen(name);
+    req = off+4+len;
+    if(req > buflen) {
+      buflen = req < buflen*2 ? buflen*2 : req;
+      buf = xrealloc(buf, buflen);
     }
+    strcpy(buf+off, name);
+    off += len+1;
+    buf[off++] = 0;
+  }
+  if(ferror(fp))
+    *err = 1;
+  fclose(fp);
 
-    len = strlen(item->d_name);
-    req = off + 3 + len;
+  /* the trash of deletions on the filesystem of the root is in the root
+   * itself, it's included so that final() can offer to clean it up */
+  if(access(TRASH_NAME, F_OK) == 0) {
+    len = strlen(TRASH_NAME);
+    req = off+4+len;
     if(req > buflen) {
-      buflen = req < buflen * 2 ? buflen * 2 : req;
+      buflen = req < buflen*2 ? buflen*2 : req;
       buf = xrealloc(buf, buflen);
     }
-    strcpy(buf + off, item->d_name);
-    off += len + 1;
-
-    dir_walk(dir);
+    strcpy(buf+off, TRASH_NAME);
+    off += len+1;
+    buf[off++] = 0;
   }
 
-  if(pclose(fp) == -1) {
-    perror("pclose failed");
-  }
+  buf[off] = 0;
+  buf[off+1] = 0;
+  return buf;
 }
 
 static int process(void) {
   char *path;
-  char *dir;
-  int fail = 0;
+  char *dir = NULL;
+  int fail = 0, reuse = 0, listing;
   struct stat fs;
+  struct dir *cached = NULL;
+  struct work *w;
+
+  stats_phase(PH_SCAN);
+  twopass = dir_scan_twopass && !refresh_orig;
+  if(twopass)
+    dir_sizes_begin();
 
   memset(buf_dir, 0, offsetof(struct dir, name));
   memset(buf_ext, 0, sizeof(struct dir_ext));
   buf_nlink = 0;
 
-  if(strcmp(dir_curpath, "/Volumes/.timemachine") == 0) {
-    listbackups();
-    pstate = ST_BROWSE;
-    return 0;
-  } else if((path = path_real(dir_curpath)) == NULL)
+  listing = strcmp(dir_curpath, "/Volumes/.timemachine") == 0;
+  if((path = path_real(dir_curpath)) == NULL)
     dir_seterr("Error obtaining full path: %s", strerror(errno));
   else {
     dir_curpath_set(path);
     free(path);
+    if(!refresh_orig)
+      watch_root(dir_curpath);
   }
 
   if(!dir_fatalerr && path_chdir(dir_curpath) < 0)
     dir_seterr("Error changing directory: %s", strerror(errno));
+  else if(!dir_fatalerr)
+    workdir = xstrdup(dir_curpath);
 
   /* Can these even fail after a chdir? */
   if(!dir_fatalerr && lstat(".", &fs) != 0)
@@ -441,29 +808,58 @@ static int process(void) {
   if(!dir_fatalerr && !S_ISDIR(fs.st_mode))
     dir_seterr("Not a directory");
 
-  if(!dir_fatalerr && !(dir = dir_read(&fail)))
+  if(!dir_fatalerr) {
+    curdev = (uint64_t)fs.st_dev;
+    stat_to_dir(&fs);
+    /* the cache takes the place of the old tree for a new scan */
+    if(!refresh_orig && (cache_file || resume_file))
+      refresh_orig = cached = cache_load(dir_curpath);
+    /* the listing changes without changing the root */
+    reuse = !listing && !refresh_shallow && dir_unchanged(refresh_orig);
+    watch_dir(dir_curpath, buf_dir->dev);
+    if(reuse)
+      dir_scan_reused_dirs++;
+    else
+      dir_scan_read_dirs++;
+  }
+
+  if(!dir_fatalerr && listing && !(dir = listbackups(&fail)))
+    dir_seterr("Error reading the list of backups: %s", strerror(errno));
+  else if(!dir_fatalerr && !listing && !reuse && !(dir = dir_read(&fail)))
     dir_seterr("Error reading directory: %s", strerror(errno));
 
   if(!dir_fatalerr) {
-    curdev = (uint64_t)fs.st_dev;
     if(fail)
       buf_dir->flags |= FF_ERR;
-    stat_to_dir(&fs);
 
     if(dir_output.item(buf_dir, dir_curpath, buf_ext, buf_nlink)) {
       dir_seterr("Output error: %s", strerror(errno));
       fail = 1;
     }
+    olddir = refresh_orig;
     if(!fail)
-      fail = dir_walk(dir);
+      fail = reuse ? dir_reuse(refresh_orig) : dir_walk(dir);
+    olddir = NULL;
     if(!fail && dir_output.item(NULL, 0, NULL, 0)) {
       dir_seterr("Output error: %s", strerror(errno));
       fail = 1;
     }
+    while((w = work_pop()) != NULL) {
+      if(!fail)
+        fail = dir_scan_work(w);
+      free(w);
+    }
   }
 
-  while(dir_fatalerr && !input_handle(0))
+  while(dir_fatalerr && !refresh_shallow && !input_handle(0))
     ;
+  /* the old tree is freed by final() */
+  refresh_orig = NULL;
+  free(workdir);
+  workdir = NULL;
+  refresh_shallow = 0;
+  if(cached)
+    cache_free(cached);
   return dir_output.final(dir_fatalerr || fail);
 }
 
@@ -475,5 +871,21 @@ void dir_scan_init(const char *path) {
   dir_process = process;
   if (!buf_dir)
     buf_dir = xmalloc(dir_memsize(""));
+  refresh_orig = NULL;
+  refresh_shallow = 0;
+  focus = browsed = NULL;
+  dir_scan_reused_dirs = dir_scan_read_dirs = dir_scan_reused_items = 0;
   pstate = ST_CALC;
 }
+
+
+void dir_scan_refresh(struct dir *orig) {
+  dir_scan_init(getpath(orig));
+  refresh_orig = orig;
+}
+
+
+void dir_scan_watch(struct dir *orig) {
+  dir_scan_refresh(orig);
+  refresh_shallow = 1;
+}
@@ -0,0 +1,394 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "global.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <khashl.h>
+
+
+/* The second pass of a two-pass scan. The files that the first pass left
+ * without lstat() are grouped into a batch per directory, and a pool of
+ * worker threads calls fstatat() on them relative to the directory. The main
+ * thread fills the results into the tree and keeps the UI going. Until all
+ * batches below a directory are done, it has FF_SCAN set. */
+
+#define SIZES_MAX_THREADS 16
+
+struct batch {
+  struct batch *next;
+  struct dir *dir;
+  struct dir **items;
+  struct stat *st;   /* results, only allocated while the batch is in flight */
+  char *err;         /* per item, whether fstatat() failed */
+  int64_t own;       /* size of the directory itself */
+  uint64_t ns;       /* time spent in fstatat(), for --stats */
+  int n, fail;       /* fail: the directory couldn't be opened */
+  char path[FLEXIBLE_ARRAY_MEMBER];
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER, wake = PTHREAD_COND_INITIALIZER;
+static struct batch *queue, *done; /* protected by lock */
+static int quit;
+
+static pthread_t threads[SIZES_MAX_THREADS];
+static int nthreads;
+
+static struct batch **all;
+static int nall, nall_size, next, inflight;
+static uint64_t rootdev;
+
+/* Number of unfinished batches in and below every directory */
+#define pending_hash(d) kh_hash_uint64((khint64_t)(uintptr_t)(d))
+KHASHL_MAP_INIT(KH_LOCAL, sp_t, sp, struct dir *, int, pending_hash, kh_eq_generic)
+static sp_t *pending;
+
+/* Progress and statistics */
+static long total, filled, structure_items;
+static struct timeval t_begin, t_mid, t_end;
+static int running;
+
+
+static double elapsed(struct timeval *a, struct timeval *b) {
+  return (b->tv_sec - a->tv_sec) + (b->tv_usec - a->tv_usec) / 1e6;
+}
+
+
+static void stat_batch(struct batch *b) {
+  struct stat st;
+  int i, dfd;
+  uint64_t t = trace_begin();
+
+  if((dfd = open(b->path, O_RDONLY|O_DIRECTORY|O_CLOEXEC)) < 0) {
+    b->fail = 1;
+    return;
+  }
+  if(!fstat(dfd, &st))
+    b->own = st.st_blocks * S_BLKSIZE;
+  b->ns = stats_enabled ? stats_now() : 0;
+  for(i=0; i<b->n; i++) {
+    if(fstatat(dfd, b->items[i]->name, b->st+i, AT_SYMLINK_NOFOLLOW))
+      b->err[i] = 1;
+    else if(follow_symlinks && S_ISLNK(b->st[i].st_mode)
+        && !fstatat(dfd, b->items[i]->name, &st, 0) && !S_ISDIR(st.st_mode))
+      b->st[i] = st;
+  }
+  if(b->ns)
+    b->ns = stats_now() - b->ns;
+  close(dfd);
+  trace_span("fstatat batch", t, b->path, b->n);
+}
+
+
+static void *sizes_worker(void *arg) {
+  struct batch *b;
+
+  trace_thread("sizes worker");
+  pthread_mutex_lock(&lock);
+  while(1) {
+    while(!queue && !quit)
+      pthread_cond_wait(&work, &lock);
+    if(quit)
+      break;
+    b = queue;
+    queue = b->next;
+    pthread_mutex_unlock(&lock);
+    stat_batch(b);
+    pthread_mutex_lock(&lock);
+    b->next = done;
+    done = b;
+    pthread_cond_signal(&wake);
+  }
+  pthread_mutex_unlock(&lock);
+  return arg;
+}
+
+
+/* Creates the batches for d and everything below it */
+static void collect(struct dir *d) {
+  struct batch *b;
+  struct dir *t;
+  khint_t k;
+  int n = 0, absent;
+
+  for(t=d->sub; t; t=t->next) {
+    if(t->flags & FF_DIR)
+      collect(t);
+    else if(!t->ino && !(t->flags & (FF_ERR|FF_EXL|FF_OTHFS|FF_KERNFS|FF_FRMLNK)))
+      n++;
+  }
+  if(!n)
+    return;
+
+  b = xcalloc(1, offsetof(struct batch, path) + strlen(getpath(d)) + 1);
+  strcpy(b->path, getpath(d));
+  b->dir = d;
+  b->items = xmalloc(n*sizeof(*b->items));
+  for(t=d->sub; t; t=t->next)
+    if(!(t->flags & FF_DIR) && !t->ino && !(t->flags & (FF_ERR|FF_EXL|FF_OTHFS|FF_KERNFS|FF_FRMLNK)))
+      b->items[b->n++] = t;
+  total += n;
+
+  if(nall == nall_size) {
+    nall_size = nall_size ? nall_size*2 : 64;
+    all = xrealloc(all, nall_size*sizeof(*all));
+  }
+  all[nall++] = b;
+
+  for(t=d; t; t=t->parent) {
+    k = sp_put(pending, t, &absent);
+    kh_val(pending, k) = absent ? 1 : kh_val(pending, k)+1;
+    t->flags |= FF_SCAN;
+  }
+}
+
+
+/* Fills the results of a batch into the tree */
+static void apply(struct batch *b) {
+  static struct dir *item;
+  struct dir_ext ext;
+  struct stat *st;
+  struct dir *t;
+  int64_t own = b->own;
+  khint_t k;
+  int i;
+
+  if(!item)
+    item = xmalloc(dir_memsize(""));
+  stats_add(STAT_FSTATAT, b->n, b->ns);
+
+  for(i=0; i<b->n; i++) {
+    memset(item, 0, offsetof(struct dir, name));
+    memset(&ext, 0, sizeof(ext));
+    st = b->st+i;
+    if(b->fail || b->err[i]) {
+      item->flags = FF_ERR;
+      dir_curpath_set(b->path);
+      dir_curpath_enter(b->items[i]->name);
+      dir_setlasterr(dir_curpath);
+    } else {
+      item->ino = (uint64_t)st->st_ino;
+      item->dev = (uint64_t)st->st_dev;
+      if(S_ISREG(st->st_mode))
+        item->flags |= FF_FILE;
+      if(!S_ISDIR(st->st_mode) && st->st_nlink > 1)
+        item->flags |= FF_HLNKC;
+      if(dir_scan_smfs && item->dev != rootdev)
+        item->flags |= FF_OTHFS;
+      else {
+        item->size = st->st_blocks * S_BLKSIZE;
+        item->asize = st->st_size;
+      }
+      ext.mode  = st->st_mode;
+      ext.mtime = st->st_mtime;
+      ext.uid   = (int)st->st_uid;
+      ext.gid   = (int)st->st_gid;
+      ext.flags = FFE_MTIME | FFE_UID | FFE_GID | FFE_MODE;
+    }
+    dir_mem_fill(b->items[i], item, &ext);
+  }
+  filled += b->n;
+
+  /* The own size of the directory for the top list. Unlike during a scan,
+   * hard links within the directory are counted every time. */
+  if(!b->fail) {
+    for(t=b->dir->sub; t; t=t->next)
+      if(!(t->flags & FF_DIR))
+        own = adds64(own, t->size);
+    top_dir(b->dir, own);
+  }
+
+  for(t=b->dir; t; t=t->parent)
+    if((k = sp_get(pending, t)) != kh_end(pending) && --kh_val(pending, k) == 0) {
+      sp_del(pending, k);
+      t->flags &= ~FF_SCAN;
+    }
+}
+
+
+static void free_batch(struct batch *b) {
+  free(b->items);
+  free(b->st);
+  free(b->err);
+  free(b);
+}
+
+
+static int process(void) {
+  struct batch *b, *chain, *list;
+  struct timespec ts;
+  struct timeval tv;
+  int fail = 0, max = nthreads ? nthreads*4 : 1;
+
+  while(1) {
+    /* hand out a limited number of batches, the results take memory */
+    for(chain=NULL; inflight < max && next < nall; inflight++) {
+      b = all[next++];
+      b->st = xmalloc(b->n*sizeof(struct stat));
+      b->err = xcalloc(b->n, 1);
+      b->next = chain;
+      chain = b;
+    }
+    if(!nthreads && chain) {
+      stat_batch(chain);
+      done = chain;
+      chain = NULL;
+    }
+
+    pthread_mutex_lock(&lock);
+    if(chain) {
+      for(b=chain; b->next; b=b->next)
+        ;
+      b->next = queue;
+      queue = chain;
+      pthread_cond_broadcast(&work);
+    }
+    list = done;
+    done = NULL;
+    pthread_mutex_unlock(&lock);
+
+    for(; list; list=b) {
+      b = list->next;
+      apply(list);
+      free_batch(list);
+      inflight--;
+    }
+
+    if(next == nall && !inflight)
+      break;
+    if(input_handle(1)) {
+      fail = 1;
+      break;
+    }
+
+    pthread_mutex_lock(&lock);
+    if(!done && (inflight == max || next == nall)) {
+      gettimeofday(&tv, NULL);
+      ts.tv_sec = tv.tv_sec;
+      ts.tv_nsec = (tv.tv_usec + update_delay*1000L) * 1000L;
+      ts.tv_sec += ts.tv_nsec / 1000000000L;
+      ts.tv_nsec %= 1000000000L;
+      pthread_cond_timedwait(&wake, &lock, &ts);
+    }
+    pthread_mutex_unlock(&lock);
+  }
+
+  pthread_mutex_lock(&lock);
+  quit = 1;
+  pthread_cond_broadcast(&work);
+  pthread_mutex_unlock(&lock);
+  while(nthreads > 0)
+    pthread_join(threads[--nthreads], NULL);
+
+  /* only left over when aborted */
+  for(; done; done=b) {
+    b = done->next;
+    free_batch(done);
+  }
+  for(; queue; queue=b) {
+    b = queue->next;
+    free_batch(queue);
+  }
+  for(; next < nall; next++)
+    free_batch(all[next]);
+  free(all);
+  all = NULL;
+  sp_destroy(pending);
+  pending = NULL;
+
+  gettimeofday(&t_end, NULL);
+  running = 0;
+  return dir_output.final(fail);
+}
+
+
+void dir_sizes_begin(void) {
+  gettimeofday(&t_begin, NULL);
+}
+
+
+void dir_sizes_init(struct dir *root) {
+  long nt;
+
+  stats_phase(PH_SIZES);
+  gettimeofday(&t_mid, NULL);
+  structure_items = root->items;
+  rootdev = root->dev;
+  total = filled = 0;
+  nall = nall_size = next = inflight = quit = 0;
+  pending = sp_init();
+  collect(root);
+  /* the whole-tree tables saw the files without their sizes */
+  agg_invalidate();
+
+  nt = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+  nt = nt < 4 ? 4 : nt > SIZES_MAX_THREADS ? SIZES_MAX_THREADS : nt;
+  for(nthreads=0; nthreads<nt; nthreads++)
+    if(pthread_create(threads+nthreads, NULL, sizes_worker, NULL) != 0)
+      break;
+
+  running = 1;
+  dir_process = process;
+  pstate = ST_CALC;
+}
+
+
+void dir_sizes_status(char *buf, int len) {
+  struct timeval now;
+  double t;
+  long left;
+
+  if(!running || !total) {
+    *buf = 0;
+    return;
+  }
+  gettimeofday(&now, NULL);
+  t = elapsed(&t_mid, &now);
+  if(filled && t >= 1) {
+    left = (long)(t * (total - filled) / filled);
+    snprintf(buf, len, "Sizes: %ld of %ld files (%d%%), about %ld:%02ld left",
+      filled, total, (int)(100.0 * filled / total), left / 60, left % 60);
+  } else
+    snprintf(buf, len, "Sizes: %ld of %ld files (%d%%)", filled, total, (int)(100.0 * filled / total));
+}
+
+
+void dir_sizes_stats_print(void) {
+  if(!t_mid.tv_sec || running)
+    return;
+  fprintf(stderr, "Structure pass: %.2f s, %ld items\n", elapsed(&t_begin, &t_mid), structure_items);
+  fprintf(stderr, "Size pass: %.2f s, %ld files", elapsed(&t_mid, &t_end), total);
+  if(t_end.tv_sec && elapsed(&t_mid, &t_end) > 0)
+    fprintf(stderr, " (%.0f/s)", total / elapsed(&t_mid, &t_end));
+  fputc('\n', stderr);
+}
@@ -24,10 +24,14 @@
 */
 
 #include "global.h"
-#include "strnatcmp.h"
 
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <khashl.h>
 
 
 /* public variables */
@@ -43,13 +47,137 @@ int    dirlist_sort_desc   = 1,
        dirlist_natsort     = 1;
 
 /* private state vars */
-static struct dir *parent_alloc, *head, *head_real, *selected, *top = NULL;
+static struct dir *parent_alloc, *head, *head_real, *selected;
+static int changed = 0; /* the opened dir has been modified, see dirlist_update() */
+
+
+/* The visible items of the opened directory in list order, with the parent
+ * reference at index 0. For lazily sorted lists this only covers the sorted
+ * prefix and grows along with it. vis_sel and vis_top are the indices of the
+ * selected item and the item on top of the window (-1 if unknown), vis_last
+ * is the index of the item last returned by dirlist_next() or dirlist_get(),
+ * which makes iterating over the list O(1) as well. */
+static struct dir **vis = NULL;
+static int vis_len = 0, vis_size = 0, vis_sel = 0, vis_top = -1, vis_last = 0;
+
+
+/* Sort cache. dirlist_sort() relinks the list of children in place, so a
+ * directory that hasn't been modified since it was last opened is still in
+ * sorted order. For every directory that has been opened we remember the
+ * configuration it was sorted with and the results of dirlist_fixup(), so that
+ * re-opening it doesn't have to touch the list at all. Entries are removed
+ * with dirlist_invalidate() when the directory or anything below it changes,
+ * or all at once by bumping the generation. */
+struct sortcache {
+  unsigned int gen;
+  signed char col, desc, df, natsort, hidden;
+  int sorted; /* length of the sorted prefix for lazily sorted lists, -1 if fully sorted */
+  int64_t maxs, maxa;
+  struct dir *sel;
+};
+
+#define sc_hash(d) kh_hash_uint64((khint64_t)(uintptr_t)(d))
+KHASHL_MAP_INIT(KH_LOCAL, sc_t, sc, struct dir *, struct sortcache, sc_hash, kh_eq_generic)
+static sc_t *sortcache = NULL;
+static unsigned int sortcache_gen = 0;
+
+
+/* Sorting is done on an array with the items of the opened directory, which
+ * is afterwards used to relink the list of children. Names are not compared
+ * directly, instead a collation key is computed for every item before sorting
+ * and the keys are compared with memcmp(). All keys are stored in key_buf.
+ *
+ * Lazy ordering of large directories. Only a screenful of items is visible
+ * at a time, so for directories with more than LAZY_MIN items we only move
+ * the first LAZY_BATCH items into place with a quickselect and leave the rest
+ * of the list unsorted. The sorted prefix is extended (doubling in size) when
+ * the browser walks past its end, and dirlist_idle() finishes the job while
+ * the browser is waiting for input. */
+#define LAZY_MIN   32768
+#define LAZY_BATCH 1024
+
+struct sortent {
+  struct dir *d;
+  size_t keyoff;
+  int keylen;
+};
+
+static struct sortent *sort_list = NULL;
+static int sort_len = 0, sort_size = 0, sort_sorted = 0, sort_fresh = 0;
+static unsigned char *key_buf = NULL;
+static size_t key_size = 0;
+
+#define SORT_PENDING (sort_sorted < sort_len)
 
 
 
-#define ISHIDDEN(d) (dirlist_hidden && (d) != dirlist_parent && (\
-    (d)->flags & FF_EXL || (d)->name[0] == '.' || (d)->name[strlen((d)->name)-1] == '~'\
-  ))
+#define ISHIDDEN(d) (dirlist_hidden && (d) != dirlist_parent && (d)->flags & FF_HIDN)
+
+
+static void vis_add(struct dir *d) {
+  if(ISHIDDEN(d))
+    return;
+  if(vis_len >= vis_size) {
+    vis_size = vis_size ? vis_size*2 : 1024;
+    vis = xrealloc(vis, vis_size*sizeof(*vis));
+  }
+  vis[vis_len++] = d;
+}
+
+
+/* Natural sort keys. Rather than having strnatcmp() parse the digit runs of
+ * both names on every comparison, each name is converted once into a byte
+ * string for which memcmp() gives the natural order:
+ * - whitespace is skipped, as strnatcmp() does;
+ * - other characters are mapped such that they compare like the (possibly
+ *   signed) chars that strnatcmp() compares;
+ * - a run of digits is encoded as the mapped '0' character, followed by the
+ *   number of significant digits as two bytes, the significant digits
+ *   themselves and a byte that puts runs with more leading zeros first.
+ * Numbers thus compare by their value. Unlike strnatcmp(), runs with leading
+ * zeros are not compared as if they were fractions.
+ * The key ends with the mapped terminating zero, so that a name sorts after
+ * its extensions with (signed) negative characters; it is at most 5 times as
+ * long as the name plus one byte. */
+#define KEY_CHAR(c) ((unsigned char)((c) - CHAR_MIN))
+
+static int natsort_key(const char *name, unsigned char *key) {
+  unsigned char *k = key;
+  const char *p;
+  int z, n;
+
+  while(*name) {
+    if(*name == ' ' || *name == '\t' || *name == '\r' || *name == '\n') {
+      name++;
+      continue;
+    }
+    if(*name < '0' || *name > '9') {
+      *(k++) = KEY_CHAR(*name);
+      name++;
+      continue;
+    }
+    for(z=0; *name == '0'; name++)
+      z++;
+    for(p=name; *p >= '0' && *p <= '9'; p++)
+      ;
+    n = p-name;
+    *(k++) = KEY_CHAR('0');
+    *(k++) = (n >> 8) & 0xff;
+    *(k++) = n & 0xff;
+    memcpy(k, name, n);
+    k += n;
+    *(k++) = z > 255 ? 0 : 255-z;
+    name = p;
+  }
+  *(k++) = KEY_CHAR(0);
+  return k-key;
+}
+
+
+static inline int cmp_key(const struct sortent *x, const struct sortent *y) {
+  int r = memcmp(key_buf+x->keyoff, key_buf+y->keyoff, x->keylen < y->keylen ? x->keylen : y->keylen);
+  return r ? r : x->keylen - y->keylen;
+}
 
 
 static inline int cmp_mtime(struct dir *x, struct dir*y) {
@@ -61,7 +189,9 @@ static inline int cmp_mtime(struct dir *x, struct dir*y) {
   return (x_mtime > y_mtime ? 1 : (x_mtime == y_mtime ? 0 : -1));
 }
 
-static int dirlist_cmp(struct dir *x, struct dir *y) {
+
+static int dirlist_cmp(const struct sortent *ex, const struct sortent *ey) {
+  struct dir *x = ex->d, *y = ey->d;
   int r;
 
   /* dirs are always before files when that option is set */
@@ -81,7 +211,7 @@ static int dirlist_cmp(struct dir *x, struct dir *y) {
    *
    * Note that the method used below is supposed to be fast, not readable :-)
    */
-#define CMP_NAME  (dirlist_natsort ? strnatcmp(x->name, y->name) : strcmp(x->name, y->name))
+#define CMP_NAME  cmp_key(ex, ey)
 #define CMP_SIZE  (x->size  > y->size  ? 1 : (x->size  == y->size  ? 0 : -1))
 #define CMP_ASIZE (x->asize > y->asize ? 1 : (x->asize == y->asize ? 0 : -1))
 #define CMP_ITEMS (x->items > y->items ? 1 : (x->items == y->items ? 0 : -1))
@@ -111,54 +241,324 @@ static int dirlist_cmp(struct dir *x, struct dir *y) {
 }
 
 
-static struct dir *dirlist_sort(struct dir *list) {
-  struct dir *p, *q, *e, *tail;
-  int insize, nmerges, psize, qsize, i;
-
-  insize = 1;
-  while(1) {
-    p = list;
-    list = NULL;
-    tail = NULL;
-    nmerges = 0;
-    while(p) {
-      nmerges++;
-      q = p;
-      psize = 0;
-      for(i=0; i<insize; i++) {
-        psize++;
-        q = q->next;
-        if(!q) break;
-      }
-      qsize = insize;
-      while(psize > 0 || (qsize > 0 && q)) {
-        if(psize == 0) {
-          e = q; q = q->next; qsize--;
-        } else if(qsize == 0 || !q) {
-          e = p; p = p->next; psize--;
-        } else if(dirlist_cmp(p,q) <= 0) {
-          e = p; p = p->next; psize--;
-        } else {
-          e = q; q = q->next; qsize--;
-        }
-        if(tail) tail->next = e;
-        else     list = e;
-        e->prev = tail;
-        tail = e;
+static int dirlist_qcmp(const void *x, const void *y) {
+  return dirlist_cmp(x, y);
+}
+
+
+static void sortcache_put(void);
+
+
+/* Quickselect: moves the n smallest items of l[0..len) to the front, in no
+ * particular order. */
+static void lazy_select(struct sortent *l, int len, int n) {
+  struct sortent p, t;
+  int lo = 0, hi = len-1, mid, i, j;
+
+#define SWAP(a, b) do { t = l[a]; l[a] = l[b]; l[b] = t; } while(0)
+  n--; /* index of the last item that should end up in the front */
+  while(lo < hi) {
+    /* median-of-three pivot, also acts as a sentinel for the loops below */
+    mid = lo + (hi-lo)/2;
+    if(dirlist_cmp(&l[mid], &l[lo]) < 0) SWAP(mid, lo);
+    if(dirlist_cmp(&l[hi], &l[lo]) < 0)  SWAP(hi, lo);
+    if(dirlist_cmp(&l[hi], &l[mid]) < 0) SWAP(hi, mid);
+    p = l[mid];
+    i = lo;
+    j = hi;
+    while(i <= j) {
+      while(dirlist_cmp(&l[i], &p) < 0) i++;
+      while(dirlist_cmp(&l[j], &p) > 0) j--;
+      if(i <= j) {
+        SWAP(i, j);
+        i++;
+        j--;
       }
-      p = q;
     }
-    tail->next = NULL;
-    if(nmerges <= 1) {
-      if(list->parent)
-        list->parent->sub = list;
-      return list;
+    if(n <= j)
+      hi = j;
+    else if(n >= i)
+      lo = i;
+    else
+      break;
+  }
+#undef SWAP
+}
+
+
+/* Updates the next/prev pointers of sort_list[from..] to match the array */
+static void sort_relink(int from) {
+  int i;
+  for(i=from; i<sort_len; i++) {
+    sort_list[i].d->prev = i > 0 ? sort_list[i-1].d : NULL;
+    sort_list[i].d->next = i+1 < sort_len ? sort_list[i+1].d : NULL;
+  }
+  sort_list[0].d->parent->sub = sort_list[0].d;
+}
+
+
+/* Extends the sorted prefix to at least n items, or twice its current size */
+static void lazy_extend(int n) {
+  int s = sort_sorted;
+
+  if(n < 2*s)
+    n = 2*s;
+  if(n >= sort_len)
+    n = sort_len;
+  else
+    lazy_select(sort_list+s, sort_len-s, n-s);
+  qsort(sort_list+s, n-s, sizeof(*sort_list), dirlist_qcmp);
+  sort_sorted = n;
+  sort_relink(s > 0 ? s-1 : 0);
+  for(; s<n; s++)
+    vis_add(sort_list[s].d);
+}
+
+
+/* Makes sure the given item is part of the sorted prefix */
+static void lazy_include(struct dir *d) {
+  int i;
+  if(!SORT_PENDING || !d || d == dirlist_parent)
+    return;
+  for(i=sort_sorted; i<sort_len; i++)
+    if(sort_list[i].d == d) {
+      lazy_extend(i+1);
+      return;
+    }
+}
+
+
+/* Loads the given list into sort_list and computes the sort keys */
+static void sort_load(struct dir *list) {
+  size_t off = 0, len;
+
+  for(sort_len=0; list; list=list->next) {
+    if(sort_len >= sort_size) {
+      sort_size = sort_size ? sort_size*2 : 1024;
+      sort_list = xrealloc(sort_list, sort_size*sizeof(*sort_list));
+    }
+    len = strlen(list->name);
+    if(off + 5*len+1 > key_size) {
+      key_size = key_size*2 > off + 5*len+1 ? key_size*2 : off + 5*len + 4096;
+      key_buf = xrealloc(key_buf, key_size);
+    }
+    sort_list[sort_len].d = list;
+    sort_list[sort_len].keyoff = off;
+    if(dirlist_natsort)
+      sort_list[sort_len].keylen = natsort_key(list->name, key_buf+off);
+    else {
+      memcpy(key_buf+off, list->name, len);
+      sort_list[sort_len].keylen = len;
+    }
+    off += sort_list[sort_len].keylen;
+    sort_len++;
+  }
+}
+
+
+/* Radix sort for the numeric columns. The value of the first sort column is
+ * turned into an unsigned 64-bit key that orders the same way, (key, index)
+ * pairs are sorted with a byte-wise LSD radix sort in which passes over bytes
+ * that are the same for every item are skipped, and sort_list is then
+ * permuted once. Directories are moved to the front afterwards if required,
+ * and runs of items with equal keys are sorted with dirlist_cmp() to get the
+ * remaining levels of the order. This is linear in the number of items, so
+ * it doesn't need the lazy ordering either.
+ *
+ * Large lists are split into parts of at least RADIX_PART items, one per
+ * thread. Each part computes its own keys and byte counts, and scatters its
+ * items into the positions that the counts of the preceding parts leave for
+ * it, so the passes stay stable. */
+#define RADIX_MIN 256
+#define RADIX_PART 65536
+#define RADIX_MAX_THREADS 8
+
+#define RADIX_KEYS    0 /* compute keys and count every byte */
+#define RADIX_COUNT   1 /* count byte radix_byte */
+#define RADIX_SCATTER 2 /* move to the positions in count[radix_byte] */
+
+struct radixent {
+  uint64_t key;
+  int idx;
+};
+
+static struct radixpart {
+  int from, to;
+  int count[8][256];
+} radix_part[RADIX_MAX_THREADS];
+
+static struct radixent *radix_buf = NULL, *radix_src, *radix_dst;
+static struct sortent *radix_tmp = NULL;
+static int radix_size = 0, radix_parts, radix_op, radix_byte;
+
+
+static uint64_t radix_key(struct dir *d) {
+  int64_t v = dirlist_sort_col == DL_COL_SIZE  ? d->size :
+              dirlist_sort_col == DL_COL_ASIZE ? d->asize :
+              dirlist_sort_col == DL_COL_ITEMS ? d->items :
+              d->flags & FF_EXT ? (int64_t)dir_ext_ptr(d)->mtime : 0;
+  uint64_t k = (uint64_t)v ^ ((uint64_t)1 << 63);
+  return dirlist_sort_desc ? ~k : k;
+}
+
+
+static void *radix_work(void *arg) {
+  struct radixpart *p = arg;
+  struct radixent *src = radix_src;
+  int i, b, s = radix_byte*8;
+
+  if(radix_op == RADIX_KEYS) {
+    memset(p->count, 0, sizeof(p->count));
+    for(i=p->from; i<p->to; i++) {
+      src[i].key = radix_key(sort_list[i].d);
+      src[i].idx = i;
+      for(b=0; b<8; b++)
+        p->count[b][(src[i].key >> (b*8)) & 0xff]++;
+    }
+  } else if(radix_op == RADIX_COUNT) {
+    memset(p->count[radix_byte], 0, sizeof(p->count[radix_byte]));
+    for(i=p->from; i<p->to; i++)
+      p->count[radix_byte][(src[i].key >> s) & 0xff]++;
+  } else
+    for(i=p->from; i<p->to; i++)
+      radix_dst[p->count[radix_byte][(src[i].key >> s) & 0xff]++] = src[i];
+  return NULL;
+}
+
+
+/* Runs radix_work() on every part, the first one in this thread. Parts for
+ * which no thread can be started are done here as well. */
+static void radix_run(int op) {
+  pthread_t threads[RADIX_MAX_THREADS];
+  int i, n;
+
+  radix_op = op;
+  for(n=1; n<radix_parts; n++)
+    if(pthread_create(threads+n, NULL, radix_work, radix_part+n) != 0)
+      break;
+  for(i=n; i<radix_parts; i++)
+    radix_work(radix_part+i);
+  radix_work(radix_part);
+  while(--n > 0)
+    pthread_join(threads[n], NULL);
+}
+
+
+static void radix_sort(void) {
+  struct radixent *src, *dst, *t;
+  int i, b, n, run, counted = 1;
+  unsigned int c;
+  long nt;
+
+  if(sort_len > radix_size) {
+    radix_size = sort_size;
+    radix_buf = xrealloc(radix_buf, 2*radix_size*sizeof(*radix_buf));
+    radix_tmp = xrealloc(radix_tmp, radix_size*sizeof(*radix_tmp));
+  }
+  src = radix_buf;
+  dst = radix_buf+radix_size;
+
+  nt = sysconf(_SC_NPROCESSORS_ONLN);
+  nt = nt > sort_len/RADIX_PART ? sort_len/RADIX_PART : nt;
+  radix_parts = nt < 1 ? 1 : nt > RADIX_MAX_THREADS ? RADIX_MAX_THREADS : nt;
+  for(i=0; i<radix_parts; i++) {
+    radix_part[i].from = (int)((int64_t)sort_len*i/radix_parts);
+    radix_part[i].to = (int)((int64_t)sort_len*(i+1)/radix_parts);
+  }
+  radix_src = src;
+  radix_run(RADIX_KEYS);
+
+  for(b=0; b<8; b++) {
+    c = (src[0].key >> (b*8)) & 0xff;
+    for(i=n=0; i<radix_parts; i++)
+      n += radix_part[i].count[b][c];
+    if(n == sort_len)
+      continue;
+    radix_src = src;
+    radix_dst = dst;
+    radix_byte = b;
+    /* the counts from RADIX_KEYS are of the original order */
+    if(!counted)
+      radix_run(RADIX_COUNT);
+    for(c=n=0; c<256; c++)
+      for(i=0; i<radix_parts; i++) {
+        run = radix_part[i].count[b][c];
+        radix_part[i].count[b][c] = n;
+        n += run;
+      }
+    radix_run(RADIX_SCATTER);
+    counted = 0;
+    t = src;
+    src = dst;
+    dst = t;
+  }
+
+  /* permute, with directories first if they should be */
+  n = 0;
+  if(dirlist_sort_df)
+    for(i=0; i<sort_len; i++)
+      if(sort_list[src[i].idx].d->flags & FF_DIR) {
+        dst[n] = src[i];
+        radix_tmp[n++] = sort_list[src[i].idx];
+      }
+  for(i=0; i<sort_len; i++)
+    if(!dirlist_sort_df || !(sort_list[src[i].idx].d->flags & FF_DIR)) {
+      dst[n] = src[i];
+      radix_tmp[n++] = sort_list[src[i].idx];
     }
-    insize *= 2;
+  memcpy(sort_list, radix_tmp, sort_len*sizeof(*sort_list));
+
+  /* break ties */
+  for(i=0; i<sort_len; i=run) {
+    for(run=i+1; run<sort_len && dst[run].key == dst[i].key && (!dirlist_sort_df
+        || (sort_list[run].d->flags & FF_DIR) == (sort_list[i].d->flags & FF_DIR)); run++)
+      ;
+    if(run-i > 1)
+      qsort(sort_list+i, run-i, sizeof(*sort_list), dirlist_qcmp);
   }
 }
 
 
+/* Sorts the given list of children of the opened directory, lazily if it's
+ * large enough, and returns the new head of the list. */
+static struct dir *dirlist_sort(struct dir *list) {
+  uint64_t t = trace_begin();
+
+  sort_load(list);
+  sort_sorted = 0;
+  if(dirlist_sort_col != DL_COL_NAME && sort_len >= RADIX_MIN) {
+    radix_sort();
+    sort_sorted = sort_len;
+    sort_relink(0);
+  } else if(sort_len > LAZY_MIN) {
+    sort_fresh = 1;
+    lazy_extend(LAZY_BATCH);
+  } else {
+    qsort(sort_list, sort_len, sizeof(*sort_list), dirlist_qcmp);
+    sort_sorted = sort_len;
+    sort_relink(0);
+  }
+  if(t)
+    trace_span("sort", t, getpath(list->parent), sort_len);
+  return sort_list[0].d;
+}
+
+
+int dirlist_idle(void) {
+  if(!SORT_PENDING)
+    return 0;
+  /* give the browser a chance to draw the first screen */
+  if(sort_fresh) {
+    sort_fresh = 0;
+    return 1;
+  }
+  lazy_extend(0);
+  if(!SORT_PENDING)
+    sortcache_put();
+  return SORT_PENDING;
+}
+
+
 /* passes through the dir listing once and:
  * - makes sure one, and only one, visible item is selected
  * - updates the dirlist_(maxs|maxa) values
@@ -191,14 +591,137 @@ static void dirlist_fixup(void) {
   }
 
   /* no selected items found after one pass? select the first visible item */
-  if(!selected)
-    if((selected = dirlist_next(NULL)))
+  if(!selected) {
+    for(t=head; t && ISHIDDEN(t); t=t->next)
+      ;
+    if((selected = t))
       selected->flags |= FF_BSEL;
+  }
+}
+
+
+/* Rebuilds the vis array after the list has been (re)sorted, opened or its
+ * visibility changed. The top item keeps its place if it's still visible. */
+static void vis_build(void) {
+  struct dir *t, *otop = vis_top >= 0 && vis_top < vis_len ? vis[vis_top] : NULL;
+  int i;
+
+  vis_len = 0;
+  if(dirlist_parent)
+    vis_add(dirlist_parent);
+  for(t=head_real, i=0; t && (!SORT_PENDING || i < sort_sorted); t=t->next, i++)
+    vis_add(t);
+
+  vis_sel = vis_last = 0;
+  vis_top = -1;
+  for(i=0; i<vis_len; i++) {
+    if(vis[i] == selected)
+      vis_sel = i;
+    if(vis[i] == otop)
+      vis_top = i;
+  }
+}
+
+
+/* Returns the index of the given visible item in vis, or -1 */
+static int vis_index(struct dir *d) {
+  int i;
+  if(vis_last < vis_len && vis[vis_last] == d)
+    return vis_last;
+  if(vis_sel < vis_len && vis[vis_sel] == d)
+    return vis_sel;
+  for(i=0; i<vis_len; i++)
+    if(vis[i] == d)
+      return i;
+  return -1;
+}
+
+
+/* Makes sure vis has an item at index i, if the list is long enough */
+static void vis_need(int i) {
+  while(i >= vis_len && SORT_PENDING)
+    lazy_extend(0);
+}
+
+
+/* Looks up the cache entry of the given directory. Returns 1 and fills *c if
+ * the directory is still sorted with the current configuration. */
+static int sortcache_get(struct dir *d, struct sortcache *c) {
+  khint_t k;
+
+  if(!sortcache || (k = sc_get(sortcache, d)) == kh_end(sortcache))
+    return 0;
+  *c = kh_val(sortcache, k);
+  return c->gen == sortcache_gen && c->col == dirlist_sort_col && c->desc == dirlist_sort_desc
+      && c->df == dirlist_sort_df && c->natsort == dirlist_natsort;
+}
+
+
+/* Remember the state of the currently opened directory */
+static void sortcache_put(void) {
+  struct sortcache c;
+  khint_t k;
+  int absent;
+
+  if(!dirlist_par)
+    return;
+  if(!sortcache)
+    sortcache = sc_init();
+  c.gen     = sortcache_gen;
+  c.col     = dirlist_sort_col;
+  c.desc    = dirlist_sort_desc;
+  c.df      = dirlist_sort_df;
+  c.natsort = dirlist_natsort;
+  c.hidden  = dirlist_hidden;
+  c.maxs    = dirlist_maxs;
+  c.maxa    = dirlist_maxa;
+  c.sel     = selected == dirlist_parent ? NULL : selected;
+  c.sorted  = SORT_PENDING ? sort_sorted : -1;
+  k = sc_put(sortcache, dirlist_par, &absent);
+  kh_val(sortcache, k) = c;
+}
+
+
+void dirlist_forget(struct dir *d) {
+  khint_t k;
+  if(sortcache && kh_size(sortcache) && (k = sc_get(sortcache, d)) != kh_end(sortcache))
+    sc_del(sortcache, k);
+}
+
+
+void dirlist_invalidate(struct dir *d) {
+  if(!d) {
+    sortcache_gen++;
+    if(sortcache)
+      sc_m_clear(sortcache);
+    changed = 1;
+    return;
+  }
+  for(; d; d=d->parent) {
+    if(d == dirlist_par)
+      changed = 1;
+    if(sortcache && kh_size(sortcache))
+      dirlist_forget(d);
+  }
+}
+
+
+void dirlist_update(void) {
+  if(changed && dirlist_par)
+    dirlist_open(dirlist_par);
 }
 
 
 void dirlist_open(struct dir *d) {
+  struct sortcache c;
+  int cached = 0;
+
+  /* save the selection of the directory we're leaving */
+  if(dirlist_par && sortcache_get(dirlist_par, &c))
+    sortcache_put();
+
   dirlist_par = d;
+  changed = 0;
 
   /* set the head of the list */
   head_real = head = d == NULL ? NULL : d->sub;
@@ -212,9 +735,14 @@ void dirlist_open(struct dir *d) {
     return;
   }
 
-  /* sort the dir listing */
-  if(head)
+  /* sort the dir listing, unless it is still sorted from last time */
+  sort_len = sort_sorted = 0;
+  if(head && !(cached = sortcache_get(d, &c)))
     head_real = head = dirlist_sort(head);
+  else if(head && c.sorted >= 0) {
+    sort_load(head);
+    sort_sorted = c.sorted;
+  }
 
   /* set the reference to the parent dir */
   if(d->parent) {
@@ -230,84 +758,65 @@ void dirlist_open(struct dir *d) {
   } else
     dirlist_parent = NULL;
 
-  dirlist_fixup();
+  /* the fixup pass can be skipped as well if we still know its results */
+  if(cached && c.hidden == dirlist_hidden && c.sel && c.sel->flags & FF_BSEL) {
+    dirlist_maxs = c.maxs;
+    dirlist_maxa = c.maxa;
+    selected = c.sel;
+  } else
+    dirlist_fixup();
+  lazy_include(selected);
+  vis_build();
+  sortcache_put();
 }
 
 
 struct dir *dirlist_next(struct dir *d) {
+  int i = 0;
+
   if(!head)
     return NULL;
-  if(!d) {
-    if(!ISHIDDEN(head))
-      return head;
-    else
-      d = head;
-  }
-  while((d = d->next)) {
-    if(!ISHIDDEN(d))
-      return d;
-  }
-  return NULL;
-}
-
-
-static struct dir *dirlist_prev(struct dir *d) {
-  if(!head || !d)
+  if(d && (i = vis_index(d)+1) == 0)
     return NULL;
-  while((d = d->prev)) {
-    if(!ISHIDDEN(d))
-      return d;
-  }
-  if(dirlist_parent)
-    return dirlist_parent;
-  return NULL;
+  vis_need(i);
+  if(i >= vis_len)
+    return NULL;
+  vis_last = i;
+  return vis[i];
 }
 
 
 struct dir *dirlist_get(int i) {
-  struct dir *t = selected, *d;
-
-  if(!head)
+  if(!head || !vis_len)
     return NULL;
 
   if(ISHIDDEN(selected)) {
-    selected = dirlist_next(NULL);
+    selected = vis[0];
+    vis_sel = 0;
     return selected;
   }
 
-  /* i == 0? return the selected item */
-  if(!i)
-    return selected;
-
-  /* positive number? simply move forward */
-  while(i > 0) {
-    d = dirlist_next(t);
-    if(!d)
-      return t;
-    t = d;
-    if(!--i)
-      return t;
-  }
-
-  /* otherwise, backward */
-  while(1) {
-    d = dirlist_prev(t);
-    if(!d)
-      return t;
-    t = d;
-    if(!++i)
-      return t;
-  }
+  i += vis_sel;
+  if(i < 0)
+    i = 0;
+  vis_need(i);
+  if(i >= vis_len)
+    i = vis_len-1;
+  vis_last = i;
+  return vis[i];
 }
 
 
 void dirlist_select(struct dir *d) {
-  if(!d || !head || ISHIDDEN(d) || d->parent != head->parent)
+  int i;
+
+  if(!d || !head || ISHIDDEN(d) || d->parent != head->parent || (i = vis_index(d)) < 0)
     return;
 
   selected->flags &= ~FF_BSEL;
   selected = d;
   selected->flags |= FF_BSEL;
+  vis_sel = i;
 }
 
 
@@ -331,44 +840,31 @@ void dirlist_select(struct dir *d) {
  * selected item is visible.
  */
 struct dir *dirlist_top(int hint) {
-  struct dir *t;
-  int i, visible = 0;
+  int n = winrows-3;
+
+  if(!vis_len)
+    return NULL;
 
   if(hint == -2 || hint == -3)
-    top = NULL;
-
-  /* check whether the current selected item is within the visible window */
-  if(top) {
-    i = winrows-3;
-    t = dirlist_get(0);
-    while(t && i--) {
-      if(t == top) {
-        visible++;
-        break;
-      }
-      t = dirlist_prev(t);
-    }
-  }
+    vis_top = -1;
 
-  /* otherwise, get a new top */
-  if(!visible)
-    top = hint == -1 || hint == -4 ? dirlist_get(0) :
-          hint ==  1               ? dirlist_get(-1*(winrows-4)) :
-                                     dirlist_get(-1*(winrows-3)/2);
+  /* get a new top if the selected item is not within the visible window */
+  if(vis_top < 0 || vis_top >= vis_len || vis_top > vis_sel || vis_sel - vis_top >= n)
+    vis_top = hint == -1 || hint == -4 ? vis_sel :
+              hint ==  1               ? vis_sel-(winrows-4) :
+                                         vis_sel-(winrows-3)/2;
 
   /* also make sure that if the list is longer than the window and the last
    * item is visible, that this last item is also the last on the window */
-  t = top;
-  i = winrows-3;
-  while(t && i--)
-    t = dirlist_next(t);
-  t = top;
-  do {
-    top = t;
-    t = dirlist_prev(t);
-  } while(t && i-- > 0);
-
-  return top;
+  if(vis_top < 0)
+    vis_top = 0;
+  vis_need(vis_top+n-1);
+  if(vis_top > vis_len-n)
+    vis_top = vis_len-n;
+  if(vis_top < 0)
+    vis_top = 0;
+
+  return vis[vis_top];
 }
 
 
@@ -388,6 +884,9 @@ void dirlist_set_sort(int col, int desc, int df) {
     dirlist_parent->next = head_real;
   else
     head = head_real;
+  lazy_include(selected);
+  vis_build();
+  sortcache_put();
   dirlist_top(-3);
 }
 
@@ -395,5 +894,8 @@ void dirlist_set_sort(int col, int desc, int df) {
 void dirlist_set_hidden(int hidden) {
   dirlist_hidden = hidden;
   dirlist_fixup();
+  lazy_include(selected);
+  vis_build();
+  sortcache_put();
   dirlist_top(-5);
 }
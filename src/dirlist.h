@@ -63,6 +63,23 @@ void dirlist_set_sort(int column, int desc, int df);
 /* Set the hidden thingy */
 void dirlist_set_hidden(int hidden);
 
+/* Performs a small part of any pending background work, to be called while
+ * the browser is waiting for input. Returns 0 when there's nothing left to do. */
+int dirlist_idle(void);
+
+/* Drop the cached sort order of the given directory and all of its parents.
+ * Must be called whenever the directory or anything below it is modified.
+ * NULL drops the cached order of every directory. */
+void dirlist_invalidate(struct dir *);
+
+/* Re-opens the opened directory if its contents have been modified since it
+ * was opened, which happens while browsing a tree that is being scanned. Must
+ * be called before any of the above functions in that case. */
+void dirlist_update(void);
+
+/* Drop the cached sort order of a single directory that is about to be freed */
+void dirlist_forget(struct dir *);
+
 
 /* DO NOT WRITE TO ANY OF THE BELOW VARIABLES FROM OUTSIDE OF dirlist.c! */
 
@@ -88,6 +88,22 @@ int exclude_match(char *path) {
 }
 
 
+/* Hash of the configured patterns, to tell whether they have changed */
+unsigned int exclude_hash(void) {
+  struct exclude *n;
+  unsigned int h = 2166136261U;
+  const char *c;
+
+  for(n=excludes; n!=NULL; n=n->next)
+    for(c=n->pattern; ; c++) {
+      h = (h ^ (unsigned char)*c) * 16777619U;
+      if(!*c)
+        break;
+    }
+  return h;
+}
+
+
 void exclude_clear(void) {
   struct exclude *n, *l;
 
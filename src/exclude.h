@@ -29,6 +29,7 @@
 void exclude_add(char *);
 int  exclude_addfile(char *);
 int  exclude_match(char *);
+unsigned int exclude_hash(void);
 void exclude_clear(void);
 int  has_cachedir_tag(const char *name);
 
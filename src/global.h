@@ -53,6 +53,11 @@
 #define FF_EXT    0x100 /* extended struct available */
 #define FF_KERNFS 0x200 /* excluded because it was a Linux pseudo filesystem */
 #define FF_FRMLNK 0x400 /* excluded because it was a firmlink */
+#define FF_HIDN   0x800 /* may be hidden in the browser (set by dir_mem.c) */
+#define FF_SCAN  0x1000 /* directory is still being scanned (set by dir_mem.c) */
+#define FF_TOP   0x2000 /* listed among the largest items (top.c) */
+#define FF_GONE  0x4000 /* removed from disk, to be freed (delete.c) */
+#define FF_MARK  0x8000 /* marked for a batch operation (mark.c) */
 
 /* Ext mode flags (struct dir_ext -> flags) */
 #define FFE_MTIME 0x01
@@ -67,6 +72,10 @@
 #define ST_HELP   3
 #define ST_SHELL  4
 #define ST_QUIT   5
+#define ST_SEARCH 6
+#define ST_TOP    7
+#define ST_AGG    8
+#define ST_TRASH  9
 
 
 /* structure representing a file or directory */
@@ -147,5 +156,16 @@ void close_nc(void);
 #include "util.h"
 #include "shell.h"
 #include "quit.h"
+#include "search.h"
+#include "top.h"
+#include "agg.h"
+#include "uring.h"
+#include "trash.h"
+#include "mark.h"
+#include "stamp.h"
+#include "cache.h"
+#include "watch.h"
+#include "stats.h"
+#include "trace.h"
 
 #endif
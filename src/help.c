@@ -32,7 +32,7 @@
 static int page, start;
 
 
-#define KEYS 19
+#define KEYS 25
 static const char *keys[KEYS*2] = {
 /*|----key----|  |----------------description----------------|*/
         "up, k", "Move cursor up",
@@ -43,7 +43,9 @@ static const char *keys[KEYS*2] = {
             "s", "Sort by size (ascending/descending)",
             "C", "Sort by items (ascending/descending)",
             "M", "Sort by mtime (-e flag)",
-            "d", "Delete selected file or directory",
+        "space", "Mark/unmark selected item",
+            "x", "Unmark all items",
+            "d", "Delete selected or all marked items",
             "t", "Toggle dirs before files when sorting",
             "g", "Show percentage and/or graph",
             "a", "Toggle between apparent size and disk usage",
@@ -51,13 +53,17 @@ static const char *keys[KEYS*2] = {
             "m", "Toggle display of latest mtime (-e flag)",
             "e", "Show/hide hidden or excluded files",
             "i", "Show information about selected item",
+            "/", "Search for files and directories by name",
+            "T", "Show the largest files and directories",
+            "U", "Show usage by extension, owner, group and age",
             "r", "Recalculate the current directory",
+            "R", "Recalculate only modified directories",
             "b", "Spawn shell in current directory",
             "q", "Quit ncdu"
 };
 
 
-#define FLAGS 9
+#define FLAGS 11
 static const char *flags[FLAGS*2] = {
     "!", "An error occurred while reading this directory",
     ".", "An error occurred while reading a subdirectory",
@@ -68,6 +74,8 @@ static const char *flags[FLAGS*2] = {
     "^", "Excluded Linux pseudo-filesystem",
     "H", "Same file was already counted (hard link)",
     "F", "Excluded firmlink",
+    "~", "Directory is still being scanned",
+    "*", "Marked for deletion (second column)",
 };
 
 void help_draw(void) {
@@ -34,29 +34,24 @@
 #include <sys/time.h>
 
 
-int pstate;
-int can_delete = -1;
-int can_shell = -1;
-int can_refresh = -1;
-long update_delay = 100;
-int cachedir_tags = 0;
-int extended_info = 0;
-int follow_symlinks = 0;
-int follow_firmlinks = 1;
-int confirm_quit = 0;
-int si = 0;
-int show_as = 0;
-int graph = 1;
-int show_items = 0;
-int show_mtime = 0;
-
 static int min_rows = 17, min_cols = 60;
 static int ncurses_init = 0;
 static int ncurses_tty = 0; /* Explicitly open /dev/tty instead of using stdio */
 static long lastupdate = 999;
 
+/* --frame-stats */
+static int frame_stats = 0;
+static long frame_count = 0, frame_max = 0;
+static double frame_total = 0;
+
 
 static void screen_draw(void) {
+  struct timeval start, end;
+  long usec;
+
+  if(frame_stats)
+    gettimeofday(&start, NULL);
+
   switch(pstate) {
     case ST_CALC:   dir_draw();    break;
     case ST_BROWSE: browse_draw(); break;
@@ -64,7 +59,39 @@ static void screen_draw(void) {
     case ST_SHELL:  shell_draw();  break;
     case ST_DEL:    delete_draw(); break;
     case ST_QUIT:   quit_draw();   break;
+    case ST_SEARCH: search_draw(); break;
+    case ST_TOP:    top_draw();    break;
+    case ST_AGG:    agg_draw();    break;
+    case ST_TRASH:  trash_draw();  break;
   }
+
+  if(frame_stats) {
+    gettimeofday(&end, NULL);
+    usec = (end.tv_sec - start.tv_sec)*1000000 + (end.tv_usec - start.tv_usec);
+    frame_count++;
+    frame_total += usec;
+    if(usec > frame_max)
+      frame_max = usec;
+  }
+}
+
+
+static void frame_stats_print(void) {
+  if(!frame_stats || !frame_count)
+    return;
+  fprintf(stderr, "Frames drawn: %ld, average %.3f ms, max %.3f ms\n",
+    frame_count, frame_total / frame_count / 1000.0, frame_max / 1000.0);
+  fprintf(stderr, "Browser rows repainted: %ld of %ld (%.1f%%)\n",
+    browse_rows_drawn, browse_rows_total,
+    browse_rows_total ? 100.0 * browse_rows_drawn / browse_rows_total : 0.0);
+}
+
+
+static void input_delay(int wait) {
+  if(wait == 2)
+    timeout(update_delay);
+  else
+    nodelay(stdscr, wait?1:0);
 }
 
 
@@ -72,11 +99,14 @@ static void screen_draw(void) {
  *  -1: non-blocking, always draw screen
  *   0: blocking wait for input and always draw screen
  *   1: non-blocking, draw screen only if a configured delay has passed or after keypress
+ *   2: wait for input at most the configured delay and always draw screen
  */
 int input_handle(int wait) {
   int ch;
   struct timeval tv;
 
+  stats_poll();
+  trace_progress();
   if(wait != 1)
     screen_draw();
   else {
@@ -92,14 +122,14 @@ int input_handle(int wait) {
   if(!ncurses_init)
     return wait == 0 ? 1 : 0;
 
-  nodelay(stdscr, wait?1:0);
+  input_delay(wait);
   errno = 0;
   while((ch = getch()) != ERR) {
     if(ch == KEY_RESIZE) {
       if(ncresize(min_rows, min_cols))
         min_rows = min_cols = 0;
       /* ncresize() may change nodelay state, make sure to revert it. */
-      nodelay(stdscr, wait?1:0);
+      input_delay(wait);
       screen_draw();
       continue;
     }
@@ -109,6 +139,10 @@ int input_handle(int wait) {
       case ST_HELP:   return help_key(ch);
       case ST_DEL:    return delete_key(ch);
       case ST_QUIT:   return quit_key(ch);
+      case ST_SEARCH: return search_key(ch);
+      case ST_TOP:    return top_key(ch);
+      case ST_AGG:    return agg_key(ch);
+      case ST_TRASH:  return trash_key(ch);
     }
     screen_draw();
   }
@@ -251,6 +285,12 @@ static int arg_option(int infile) {
   else if(OPT("-2")) dir_ui = 2;
   else if(OPT("--si")) si = 1;
   else if(OPT("--no-si")) si = 0;
+  else if(OPT("--trash")) trash_enabled = 1;
+  else if(OPT("--no-trash")) trash_enabled = 0;
+  else if(OPT("--watch")) watch_enabled = 1;
+  else if(OPT("--no-watch")) watch_enabled = 0;
+  else if(OPT("--two-pass")) dir_scan_twopass = 1;
+  else if(OPT("--no-two-pass")) dir_scan_twopass = 0;
   else if(OPT("-L") || OPT("--follow-symlinks")) follow_symlinks = 1;
   else if(OPT("--no-follow-symlinks")) follow_symlinks = 0;
   else if(OPT("--exclude")) {
@@ -271,6 +311,16 @@ static int arg_option(int infile) {
   else if(OPT("--no-confirm-quit")) confirm_quit = 0;
   else if(OPT("--confirm-delete")) delete_confirm = 1;
   else if(OPT("--no-confirm-delete")) delete_confirm = 0;
+  else if(OPT("--frame-stats")) frame_stats = 1;
+  else if(OPT("--stats")) stats_enabled = 1;
+  else if(OPT("--cache")) {
+    free(cache_file);
+    cache_file = infile ? expanduser(ARG) : xstrdup(ARG);
+  }
+  else if(OPT("--resume")) {
+    free(resume_file);
+    resume_file = infile ? expanduser(ARG) : xstrdup(ARG);
+  }
   else if(OPT("--color")) {
     arg = ARG;
     if(strcmp(arg, "off") == 0) uic_theme = 0;
@@ -303,6 +353,14 @@ static void arg_help(void) {
 #if HAVE_SYS_ATTR_H && HAVE_GETATTRLIST && HAVE_DECL_ATTR_CMNEXT_NOFIRMLINKPATH
   printf("  --exclude-firmlinks        Exclude firmlinks on macOS\n");
 #endif
+  printf("  --trash                    Delete in the background after moving to a trash dir\n");
+  printf("  --cache FILE               Reuse unchanged directories from cache FILE\n");
+  printf("  --resume FILE              Save the scan progress to FILE and continue from it\n");
+  printf("  --watch                    Keep the tree up to date with changes on disk\n");
+  printf("  --two-pass                 Read the directory structure first, file sizes later\n");
+  printf("  --stats                    Print timings and system call counts on exit or SIGUSR1\n");
+  printf("  --frame-stats              Print the frame times and redrawn rows on exit\n");
+  printf("  --trace FILE               Write a timeline of the scan to FILE in Chrome trace format\n");
   printf("  --confirm-quit             Confirm quitting ncdu\n");
   printf("  --color SCHEME             Set color scheme (off/dark/dark-bg)\n");
   exit(0);
@@ -380,7 +438,7 @@ static void config_load(int argc, char **argv) {
 
 static void argv_parse(int argc, char **argv) {
   int r;
-  char *export = NULL;
+  char *export = NULL, *trace = NULL;
   char *dir = "/Volumes/.timemachine";
 
   memset(&argparser_state, 0, sizeof(struct argparser));
@@ -394,6 +452,7 @@ static void argv_parse(int argc, char **argv) {
       exit(0);
     } else if(OPT("-h") || OPT("-?") || OPT("--help")) arg_help();
     else if(OPT("-o")) export = ARG;
+    else if(OPT("--trace")) trace = ARG;
     else if(OPT("--ignore-config")) {}
     else if(!arg_option(0)) die("Unknown option '%s'.\n", argparser_state.last);
   }
@@ -402,9 +461,18 @@ static void argv_parse(int argc, char **argv) {
   if(exclude_kernfs) die("The --exclude-kernfs flag is currently only supported on Linux.\n");
 #endif
 
+  if(trace && !trace_open(trace)) die("Can't open %s: %s\n", trace, strerror(errno));
+
   if(export) {
     if(dir_export_init(export)) die("Can't open %s: %s\n", export, strerror(errno));
     if(strcmp(export, "-") == 0) ncurses_tty = 1;
+    /* the cache doesn't know the link counts that the export needs */
+    free(cache_file);
+    cache_file = NULL;
+    free(resume_file);
+    resume_file = NULL;
+    watch_enabled = 0;
+    dir_scan_twopass = 0;
   } else
     dir_mem_init(NULL);
 
@@ -414,6 +482,7 @@ static void argv_parse(int argc, char **argv) {
    * feedback when exporting to stdout. */
   if(dir_ui == -1)
     dir_ui = export && strcmp(export, "-") == 0 ? 0 : export ? 1 : 2;
+  stats_init();
 
   can_delete = 1;
   can_shell = 0;
@@ -493,11 +562,25 @@ int main(int argc, char **argv) {
       }
     } else if(pstate == ST_DEL)
       delete_process();
-    else if(input_handle(0))
+    else if(pstate == ST_BROWSE && dirlist_idle()) {
+      /* there's background work to do, don't block on input */
+      if(input_handle(-1))
+        break;
+    } else if(pstate == ST_BROWSE && (trash_busy() || watch_enabled)) {
+      /* keep the background deletion status and the tree up to date */
+      watch_process();
+      if(pstate == ST_BROWSE && input_handle(2))
+        break;
+    } else if(input_handle(0))
       break;
   }
 
   close_nc();
+  frame_stats_print();
+  cache_stats_print();
+  dir_sizes_stats_print();
+  stats_print();
+  trace_close();
   exclude_clear();
 
   return 0;
@@ -0,0 +1,149 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "global.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <khashl.h>
+
+
+/* Items marked in the browser, in the order they were marked. Marked items
+ * have FF_MARK set and are removed from the list when they're freed. */
+static struct dir **marks;
+static int marks_len, marks_size;
+
+/* Cached result of mark_total(), valid unless dirty */
+static int64_t tsize, tasize;
+static int dirty;
+
+/* Hard links seen while calculating the total, with the index of the last
+ * target they were found in */
+#define link_hash(d)     (kh_hash_uint64((khint64_t)(d)->dev) ^ kh_hash_uint64((khint64_t)(d)->ino))
+#define link_equal(a, b) ((a)->dev == (b)->dev && (a)->ino == (b)->ino)
+KHASHL_MAP_INIT(KH_LOCAL, ml_t, ml, struct dir *, int, link_hash, link_equal)
+
+
+void mark_toggle(struct dir *d) {
+  if(d->flags & FF_MARK) {
+    mark_forget(d);
+    return;
+  }
+  if(marks_len == marks_size) {
+    marks_size = marks_size ? marks_size*2 : 16;
+    marks = xrealloc(marks, marks_size*sizeof(*marks));
+  }
+  marks[marks_len++] = d;
+  d->flags |= FF_MARK;
+  dirty = 1;
+}
+
+
+void mark_clear(void) {
+  while(marks_len > 0)
+    marks[--marks_len]->flags &= ~FF_MARK;
+  dirty = 1;
+}
+
+
+void mark_forget(struct dir *d) {
+  int i;
+  for(i=0; i<marks_len; i++)
+    if(marks[i] == d) {
+      memmove(marks+i, marks+i+1, (marks_len-i-1)*sizeof(*marks));
+      marks_len--;
+      break;
+    }
+  d->flags &= ~FF_MARK;
+  dirty = 1;
+}
+
+
+void mark_invalidate(void) {
+  dirty = 1;
+}
+
+
+int mark_count(void) {
+  return marks_len;
+}
+
+
+struct dir **mark_targets(int *len) {
+  struct dir **l = xmalloc((marks_len+1)*sizeof(*l)), *p;
+  int i;
+
+  *len = 0;
+  for(i=0; i<marks_len; i++) {
+    for(p=marks[i]->parent; p && !(p->flags & FF_MARK); p=p->parent)
+      ;
+    if(!p)
+      l[(*len)++] = marks[i];
+  }
+  return l;
+}
+
+
+/* Subtracts the sizes of hard links below d that have already been counted
+ * for an earlier target */
+static void total_links(ml_t *h, struct dir *d, int target) {
+  struct dir *t;
+  khint_t k;
+  int absent;
+
+  for(t=d->sub; t; t=t->next)
+    total_links(h, t, target);
+  if(!(d->flags & FF_HLNKC))
+    return;
+  k = ml_put(h, d, &absent);
+  if(!absent && kh_val(h, k) != target) {
+    tsize -= d->size;
+    tasize -= d->asize;
+  }
+  kh_val(h, k) = target;
+}
+
+
+void mark_total(int64_t *size, int64_t *asize) {
+  struct dir **l;
+  ml_t *h;
+  int i, len;
+
+  if(dirty) {
+    l = mark_targets(&len);
+    h = ml_init();
+    tsize = tasize = 0;
+    for(i=0; i<len; i++) {
+      tsize += l[i]->size;
+      tasize += l[i]->asize;
+      total_links(h, l[i], i);
+    }
+    ml_destroy(h);
+    free(l);
+    dirty = 0;
+  }
+  *size = tsize;
+  *asize = tasize;
+}
@@ -0,0 +1,53 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef _mark_h
+#define _mark_h
+
+#include "global.h"
+
+/* Marks or unmarks an item for a batch operation */
+void mark_toggle(struct dir *);
+
+/* Unmarks all items */
+void mark_clear(void);
+
+/* Removes an item that is about to be freed from the marks */
+void mark_forget(struct dir *);
+
+/* To be called when sizes in the tree may have changed */
+void mark_invalidate(void);
+
+int mark_count(void);
+
+/* Total size of the marked items, counting items below other marked items
+ * and files that are hard linked from several marked items only once */
+void mark_total(int64_t *size, int64_t *asize);
+
+/* Returns the marked items that don't have a marked parent, which covers
+ * everything that is marked. Sets *len to its length, must be freed. */
+struct dir **mark_targets(int *len);
+
+#endif
@@ -0,0 +1,404 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "global.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <ncurses.h>
+
+#include <khashl.h>
+
+
+/* The search index, built on the first search after the tree has changed:
+ * - Every distinct name gets an id, and its lowercased version is stored in
+ *   lnames at offset name_off[id].
+ * - items[] holds all items in the tree grouped by name id, the items with
+ *   name id are items[name_items[id] .. name_items[id+1]).
+ * - For every trigram that occurs in a lowercased name, tri_posts[] holds the
+ *   sorted list of name ids it occurs in.
+ * A query is matched against the names in the shortest posting list of its
+ * trigrams, or against all names if the query is shorter than 3 bytes, so
+ * the work is proportional to the number of distinct candidate names rather
+ * than the size of the tree. */
+struct trigram {
+  unsigned int start, count, last;
+};
+
+#define tri_hash(t) kh_hash_uint32(t)
+KHASHL_MAP_INIT(KH_LOCAL, tri_t, tri, khint32_t, struct trigram, tri_hash, kh_eq_generic)
+KHASHL_MAP_INIT(KH_LOCAL, nm_t, nm, const char *, unsigned int, kh_hash_str, kh_eq_str)
+
+static int built = 0;
+static char *lnames;
+static size_t *name_off;
+static unsigned int nnames, *name_items, *tri_posts;
+static struct dir **items;
+static tri_t *trigrams;
+
+/* The current query and its results */
+#define QUERY_MAX 256
+#define SORT_BATCH 1000
+static char query[QUERY_MAX];
+static struct dir **results;
+static int nresults, results_size, results_sorted, sel, top;
+
+
+/* iterate over all entries of a khashl table */
+#define KH_FOREACH(h, k) for((k)=0; (k)<kh_end(h); (k)++) if(__kh_used((h)->used, (k)))
+
+#define LOWER(c) ((c) >= 'A' && (c) <= 'Z' ? (c)-'A'+'a' : (c))
+#define TRIGRAM(s) (((khint32_t)(unsigned char)(s)[0] << 16) | ((khint32_t)(unsigned char)(s)[1] << 8) | (unsigned char)(s)[2])
+
+
+void search_invalidate(void) {
+  if(!built)
+    return;
+  built = 0;
+  free(lnames);
+  free(name_off);
+  free(name_items);
+  free(tri_posts);
+  free(items);
+  tri_destroy(trigrams);
+  free(results);
+  results = NULL;
+  nresults = results_size = results_sorted = 0;
+  trigrams = NULL;
+}
+
+
+/* Counts the items below d, not including d itself */
+static unsigned int count_items(struct dir *d) {
+  unsigned int n = 0;
+  for(d=d->sub; d; d=d->next)
+    n += 1 + (d->flags & FF_DIR ? count_items(d) : 0);
+  return n;
+}
+
+
+/* Assigns an id to every distinct name below d, items[i] has name id ids[i] */
+static void index_names(struct dir *d, nm_t *names, unsigned int *ids, unsigned int *n) {
+  khint_t k;
+  int absent;
+
+  for(d=d->sub; d; d=d->next) {
+    k = nm_put(names, d->name, &absent);
+    if(absent)
+      kh_val(names, k) = nnames++;
+    ids[*n] = kh_val(names, k);
+    items[(*n)++] = d;
+    if(d->flags & FF_DIR)
+      index_names(d, names, ids, n);
+  }
+}
+
+
+/* Runs code for every distinct trigram in the lowercased name with the given
+ * id, with k set to the entry of the trigram in the hash table */
+#define FOR_TRIGRAMS(id, code) do {\
+    const char *_s = lnames+name_off[id];\
+    khint_t k;\
+    int absent;\
+    for(; _s[0] && _s[1] && _s[2]; _s++) {\
+      k = tri_put(trigrams, TRIGRAM(_s), &absent);\
+      if(absent)\
+        memset(&kh_val(trigrams, k), 0, sizeof(struct trigram));\
+      if(kh_val(trigrams, k).last == id+1)\
+        continue;\
+      kh_val(trigrams, k).last = id+1;\
+      code;\
+    }\
+  } while(0)
+
+
+static void build(void) {
+  struct dir *root = getroot(dirlist_par), **tmp;
+  unsigned int n = 0, i, *ids, *pos, total;
+  size_t len = 0;
+  nm_t *names;
+  khint_t k;
+  char *s;
+
+  /* assign an id to every distinct name */
+  total = count_items(root);
+  items = xmalloc((total ? total : 1) * sizeof(*items));
+  ids = xmalloc((total ? total : 1) * sizeof(*ids));
+  names = nm_init();
+  nnames = 0;
+  index_names(root, names, ids, &n);
+
+  /* store the lowercased names */
+  name_off = xmalloc((nnames+1) * sizeof(*name_off));
+  KH_FOREACH(names, k)
+    len += strlen(kh_key(names, k))+1;
+  lnames = xmalloc(len ? len : 1);
+  len = 0;
+  KH_FOREACH(names, k) {
+    name_off[kh_val(names, k)] = len;
+    for(s=(char *)kh_key(names, k); *s; s++)
+      lnames[len++] = LOWER(*s);
+    lnames[len++] = 0;
+  }
+  nm_destroy(names);
+
+  /* group the items by name id */
+  name_items = xcalloc(nnames+1, sizeof(*name_items));
+  for(i=0; i<n; i++)
+    name_items[ids[i]+1]++;
+  for(i=0; i<nnames; i++)
+    name_items[i+1] += name_items[i];
+  pos = xmalloc((nnames ? nnames : 1) * sizeof(*pos));
+  memcpy(pos, name_items, (nnames ? nnames : 1) * sizeof(*pos));
+  tmp = xmalloc((n ? n : 1) * sizeof(*tmp));
+  for(i=0; i<n; i++)
+    tmp[pos[ids[i]]++] = items[i];
+  free(items);
+  free(ids);
+  free(pos);
+  items = tmp;
+
+  /* trigram posting lists, first count then fill */
+  trigrams = tri_init();
+  for(i=0; i<nnames; i++)
+    FOR_TRIGRAMS(i, kh_val(trigrams, k).count++);
+  total = 0;
+  KH_FOREACH(trigrams, k) {
+    kh_val(trigrams, k).start = total;
+    total += kh_val(trigrams, k).count;
+    kh_val(trigrams, k).count = kh_val(trigrams, k).last = 0;
+  }
+  tri_posts = xmalloc((total ? total : 1) * sizeof(*tri_posts));
+  for(i=0; i<nnames; i++)
+    FOR_TRIGRAMS(i, tri_posts[kh_val(trigrams, k).start + kh_val(trigrams, k).count++] = i);
+
+  built = 1;
+}
+
+
+static int result_cmp(const void *va, const void *vb) {
+  struct dir *a = *(struct dir **)va, *b = *(struct dir **)vb;
+  int64_t x = show_as ? a->asize : a->size, y = show_as ? b->asize : b->size;
+  return x > y ? -1 : x < y ? 1 : strcmp(a->name, b->name);
+}
+
+
+/* Makes sure that at least the first n results are sorted. Only the first
+ * SORT_BATCH results are sorted initially, the rest when scrolling past them. */
+static void results_sort(int n) {
+  int lo = 0, hi = nresults-1, i, j;
+  struct dir *p, *t;
+
+  if(n <= results_sorted)
+    return;
+  if(n >= nresults || results_sorted > 0) {
+    qsort(results+results_sorted, nresults-results_sorted, sizeof(*results), result_cmp);
+    results_sorted = nresults;
+    return;
+  }
+
+  /* quickselect the n largest results to the front */
+  while(lo < hi) {
+    p = results[lo + (hi-lo)/2];
+    i = lo;
+    j = hi;
+    while(i <= j) {
+      while(result_cmp(&results[i], &p) < 0) i++;
+      while(result_cmp(&results[j], &p) > 0) j--;
+      if(i <= j) {
+        t = results[i];
+        results[i++] = results[j];
+        results[j--] = t;
+      }
+    }
+    if(n-1 <= j)
+      hi = j;
+    else if(n-1 >= i)
+      lo = i;
+    else
+      break;
+  }
+  qsort(results, n, sizeof(*results), result_cmp);
+  results_sorted = n;
+}
+
+
+static void result_add(unsigned int id) {
+  unsigned int i;
+  for(i=name_items[id]; i<name_items[id+1]; i++) {
+    if(nresults >= results_size) {
+      results_size = results_size ? results_size*2 : 1024;
+      results = xrealloc(results, results_size * sizeof(*results));
+    }
+    results[nresults++] = items[i];
+  }
+}
+
+
+static void search_run(void) {
+  char q[QUERY_MAX], *s;
+  struct trigram best = {0};
+  unsigned int i;
+  khint_t k;
+
+  nresults = results_sorted = 0;
+  sel = top = 0;
+  if(!*query)
+    return;
+
+  for(s=q; (*s = LOWER(query[s-q])); s++)
+    ;
+
+  /* find the rarest trigram of the query */
+  for(s=q; s[0] && s[1] && s[2]; s++) {
+    if((k = tri_get(trigrams, TRIGRAM(s))) == kh_end(trigrams))
+      return;
+    if(s == q || kh_val(trigrams, k).count < best.count)
+      best = kh_val(trigrams, k);
+  }
+
+  if(s != q) {
+    for(i=best.start; i<best.start+best.count; i++)
+      if(strstr(lnames+name_off[tri_posts[i]], q))
+        result_add(tri_posts[i]);
+  } else
+    for(i=0; i<nnames; i++)
+      if(strstr(lnames+name_off[i], q))
+        result_add(i);
+
+  results_sort(nresults < SORT_BATCH ? nresults : SORT_BATCH);
+}
+
+
+void search_draw(void) {
+  int height = winrows-4, width = wincols-6, rows = height-6, i;
+  enum ui_coltype c;
+  struct dir *d;
+
+  browse_draw();
+  nccreate(height, width, "Search");
+
+  ncaddstr(2, 2, "Find: ");
+  addstrc(UIC_DEFAULT, cropstr(query, width-12));
+  addchc(UIC_SEL, ' ');
+
+  results_sort(top+rows);
+  for(i=0; i<rows && top+i < nresults; i++) {
+    d = results[top+i];
+    c = top+i == sel ? UIC_SEL : UIC_DEFAULT;
+    uic_set(c);
+    mvhline(subwinr+4+i, subwinc+1, ' ', width-2);
+    move(subwinr+4+i, subwinc+2);
+    printsize(c, show_as ? d->asize : d->size);
+    ncaddstrc(c, 4+i, 14, cropstr(getpath(d), width-16));
+  }
+
+  uic_set(UIC_DEFAULT);
+  if(!*query)
+    ncaddstr(height-2, 2, "Type to search for a name");
+  else
+    ncprint(height-2, 2, "%d result%s", nresults, nresults == 1 ? "" : "s");
+  ncaddstrc(UIC_KEY, height-2, width-30, "Enter");
+  addstrc(UIC_DEFAULT, " to open, ");
+  addstrc(UIC_KEY, "Esc");
+  addstrc(UIC_DEFAULT, " to cancel");
+}
+
+
+int search_key(int ch) {
+  int rows = winrows-10, len = strlen(query);
+  struct dir *d;
+
+  switch(ch) {
+  case 27: /* escape */
+    pstate = ST_BROWSE;
+    return 0;
+  case 10:
+  case KEY_ENTER:
+    if(!nresults)
+      break;
+    d = results[sel];
+    browse_init(d->parent);
+    if(dirlist_hidden && d->flags & FF_HIDN)
+      dirlist_set_hidden(0);
+    dirlist_select(d);
+    dirlist_top(-3);
+    return 0;
+  case KEY_UP:
+    sel--;
+    break;
+  case KEY_DOWN:
+    sel++;
+    break;
+  case KEY_PPAGE:
+    sel -= rows;
+    break;
+  case KEY_NPAGE:
+    sel += rows;
+    break;
+  case KEY_HOME:
+    sel = 0;
+    break;
+  case KEY_END:
+    sel = nresults-1;
+    break;
+  case KEY_BACKSPACE:
+  case 127:
+  case 8:
+    /* also remove any UTF-8 continuation bytes */
+    while(len > 0 && (query[--len] & 0xc0) == 0x80)
+      ;
+    query[len] = 0;
+    search_run();
+    return 0;
+  default:
+    if(ch < 32 || ch > 255 || len >= QUERY_MAX-1)
+      break;
+    query[len++] = ch;
+    query[len] = 0;
+    search_run();
+    return 0;
+  }
+
+  if(sel >= nresults)
+    sel = nresults-1;
+  if(sel < 0)
+    sel = 0;
+  if(sel < top)
+    top = sel;
+  if(sel >= top+rows)
+    top = sel-rows+1;
+  return 0;
+}
+
+
+void search_init(void) {
+  if(!dirlist_par)
+    return;
+  if(!built)
+    build();
+  pstate = ST_SEARCH;
+  search_run();
+}
@@ -92,6 +92,7 @@ void shell_draw(void) {
   }
 
   refresh();
+  browse_damage(0, winrows);
   pstate = ST_BROWSE;
 }
 
@@ -0,0 +1,81 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "global.h"
+
+#include <khashl.h>
+
+
+/* Stamps of the directories in memory that were read from disk. Kept
+ * outside of struct dir so that they don't cost anything for files, and
+ * removed by freedir(). */
+#define stamp_hash(d) kh_hash_uint64((khint64_t)(uintptr_t)(d))
+KHASHL_MAP_INIT(KH_LOCAL, st_t, st, struct dir *, struct stamp, stamp_hash, kh_eq_generic)
+static st_t *stamps;
+
+struct stamp stamp_cur;
+
+
+void stamp_from_stat(struct stamp *s, const struct stat *fs) {
+#if HAVE_STRUCT_STAT_ST_MTIM
+  s->mtime = (int64_t)fs->st_mtim.tv_sec * 1000000000 + fs->st_mtim.tv_nsec;
+  s->ctime = (int64_t)fs->st_ctim.tv_sec * 1000000000 + fs->st_ctim.tv_nsec;
+#else
+  s->mtime = (int64_t)fs->st_mtime * 1000000000;
+  s->ctime = (int64_t)fs->st_ctime * 1000000000;
+#endif
+}
+
+
+void stamp_reset(void) {
+  if(stamps)
+    st_m_clear(stamps);
+}
+
+
+void stamp_put(struct dir *d, const struct stamp *s) {
+  khint_t k;
+  int absent;
+  if(!stamps)
+    stamps = st_init();
+  k = st_put(stamps, d, &absent);
+  kh_val(stamps, k) = *s;
+}
+
+
+int stamp_get(struct dir *d, struct stamp *s) {
+  khint_t k;
+  if(!stamps || (k = st_get(stamps, d)) == kh_end(stamps))
+    return 0;
+  *s = kh_val(stamps, k);
+  return 1;
+}
+
+
+void stamp_forget(struct dir *d) {
+  khint_t k;
+  if(stamps && kh_size(stamps) && (k = st_get(stamps, d)) != kh_end(stamps))
+    st_del(stamps, k);
+}
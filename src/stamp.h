@@ -0,0 +1,55 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef _stamp_h
+#define _stamp_h
+
+#include "global.h"
+
+/* Modification and status change times of a directory, in nanoseconds where
+ * the system provides them. A directory with the same stamp as before still
+ * has the same entries. */
+struct stamp {
+  int64_t mtime, ctime;
+};
+
+/* Stamp of the directory that the scanner passes to dir_output.item(), zero
+ * if it isn't known */
+extern struct stamp stamp_cur;
+
+void stamp_from_stat(struct stamp *, const struct stat *);
+
+/* Clears the table, called before a new tree is built */
+void stamp_reset(void);
+
+void stamp_put(struct dir *, const struct stamp *);
+
+/* Returns 1 and fills in the stamp if the directory has one */
+int stamp_get(struct dir *, struct stamp *);
+
+/* Removes a directory that is about to be freed */
+void stamp_forget(struct dir *);
+
+#endif
@@ -0,0 +1,198 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "global.h"
+
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+
+int stats_enabled = 0;
+volatile sig_atomic_t stats_requested = 0;
+struct stats_counter stats_counters[STAT_COUNT];
+
+static const char *counter_names[STAT_COUNT] = {
+  "opendir", "readdir", "lstat", "stat", "statfs", "fstatat",
+  "exclude_match", "hlink_check", "addparentstats", "export"
+};
+static const char *phase_names[PH_COUNT] = { "scan", "sizes", "import", "browse" };
+
+static struct {
+  double wall, cpu;
+  int64_t items, bytes;
+} phases[PH_COUNT];
+
+static int cur = -1;
+static uint64_t cur_wall;
+static double cur_cpu;
+static int64_t cur_items, cur_bytes, cur_files;
+
+
+uint64_t stats_now(void) {
+#if HAVE_CLOCK_GETTIME
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+#endif
+}
+
+
+static double cputime(void) {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+
+static void record(struct stats_counter *c, uint64_t ns, uint64_t n) {
+  uint64_t lim = 1000;
+  int b;
+
+  for(b=0; b<STATS_BUCKETS-1 && ns >= lim; b++)
+    lim *= 4;
+  c->hist[b] += n;
+  c->sampled += n;
+  c->ns += ns * n;
+}
+
+
+void stats_record(int c, uint64_t start) {
+  uint64_t now = stats_now();
+  record(stats_counters+c, now > start ? now - start : 0, 1);
+}
+
+
+void stats_add(int c, uint64_t n, uint64_t ns) {
+  if(!stats_enabled || !n)
+    return;
+  stats_counters[c].count += n;
+  /* the histogram only knows the average */
+  record(stats_counters+c, ns / n, n);
+}
+
+
+void stats_phase(int p) {
+  uint64_t now;
+  double cpu;
+
+  if(!stats_enabled)
+    return;
+  now = stats_now();
+  cpu = cputime();
+  if(cur >= 0) {
+    phases[cur].wall += (now - cur_wall) / 1e9;
+    phases[cur].cpu += cpu - cur_cpu;
+    /* the items were already counted in the first pass */
+    if(cur == PH_SIZES)
+      phases[cur].items += stats_counters[STAT_FSTATAT].count - cur_files;
+    else if(cur != PH_BROWSE && dir_output.items > cur_items)
+      phases[cur].items += dir_output.items - cur_items;
+    if(cur != PH_BROWSE && dir_output.size > cur_bytes)
+      phases[cur].bytes += dir_output.size - cur_bytes;
+  }
+  cur = p;
+  cur_wall = now;
+  cur_cpu = cpu;
+  cur_items = dir_output.items;
+  cur_bytes = dir_output.size;
+  cur_files = stats_counters[STAT_FSTATAT].count;
+}
+
+
+static void sigusr1(int sig) {
+  (void)sig;
+  stats_requested = 1;
+}
+
+
+void stats_init(void) {
+  struct sigaction sa;
+
+  if(!stats_enabled || dir_ui == 2)
+    return;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = sigusr1;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGUSR1, &sa, NULL);
+}
+
+
+void stats_print(void) {
+  static const char *buckets[STATS_BUCKETS] = {
+    "<1us", "<4us", "<16us", "<64us", "<256us", "<1ms", "<4ms", "<16ms", "more"
+  };
+  struct stats_counter *c;
+  const char *unit;
+  float f;
+  int i, b;
+
+  if(!stats_enabled)
+    return;
+  /* include the phase that's still going on */
+  if(cur >= 0)
+    stats_phase(cur);
+
+  /* move away from the -1 progress line */
+  if(stats_requested && dir_ui == 1)
+    fputc('\n', stderr);
+  stats_requested = 0;
+  fprintf(stderr, "%-8s %10s %10s %10s %10s %12s\n", "Phase", "Wall", "CPU", "Items", "Items/s", "Bytes/s");
+  for(i=0; i<PH_COUNT; i++) {
+    if(phases[i].wall <= 0)
+      continue;
+    fprintf(stderr, "%-8s %8.3f s %8.3f s", phase_names[i], phases[i].wall, phases[i].cpu);
+    if(i == PH_BROWSE) {
+      fputc('\n', stderr);
+      continue;
+    }
+    f = formatsize((int64_t)(phases[i].bytes / phases[i].wall), &unit);
+    fprintf(stderr, " %10"PRId64" %10.0f %6.1f %s/s\n", phases[i].items, phases[i].items / phases[i].wall, f, unit);
+  }
+
+  fprintf(stderr, "\n%-14s %10s %10s %8s", "Call", "Count", "Time", "Average");
+  for(b=0; b<STATS_BUCKETS; b++)
+    fprintf(stderr, " %6s", buckets[b]);
+  fputc('\n', stderr);
+  for(i=0; i<STAT_COUNT; i++) {
+    c = stats_counters+i;
+    if(!c->count)
+      continue;
+    /* times are estimated from the sampled calls */
+    fprintf(stderr, "%-14s %10"PRIu64" %8.3f s %5.1f us", counter_names[i], c->count,
+      c->sampled ? (double)c->ns / c->sampled * c->count / 1e9 : 0.0,
+      c->sampled ? (double)c->ns / c->sampled / 1e3 : 0.0);
+    for(b=0; b<STATS_BUCKETS; b++)
+      fprintf(stderr, " %5.1f%%", c->sampled ? 100.0 * c->hist[b] / c->sampled : 0.0);
+    fputc('\n', stderr);
+  }
+  fprintf(stderr, "(one in %d calls timed)\n", STATS_SAMPLE);
+}
@@ -0,0 +1,88 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef _stats_h
+#define _stats_h
+
+#include "global.h"
+#include <signal.h>
+
+/* --stats, per-phase times and counters of the calls that a scan spends its
+ * time in. Every call is counted, but only one in STATS_SAMPLE is timed to
+ * keep the overhead low; the total times are estimated from those. */
+extern int stats_enabled;
+extern volatile sig_atomic_t stats_requested;
+
+#define STATS_SAMPLE  16
+#define STATS_BUCKETS 9 /* <1us, <4us, ... <16ms, more */
+
+#define STAT_OPENDIR  0
+#define STAT_READDIR  1
+#define STAT_LSTAT    2
+#define STAT_STAT     3
+#define STAT_STATFS   4
+#define STAT_FSTATAT  5
+#define STAT_EXCLUDE  6
+#define STAT_HLINK    7
+#define STAT_PARENTS  8
+#define STAT_EXPORT   9
+#define STAT_COUNT   10
+
+#define PH_SCAN   0
+#define PH_SIZES  1
+#define PH_IMPORT 2
+#define PH_BROWSE 3
+#define PH_COUNT  4
+
+struct stats_counter {
+  uint64_t count, sampled, ns;
+  uint64_t hist[STATS_BUCKETS];
+};
+extern struct stats_counter stats_counters[STAT_COUNT];
+
+uint64_t stats_now(void);
+void stats_record(int, uint64_t start);
+
+/* Put around a call: counts it, and measures it if it's sampled. t is a
+ * uint64_t that stats_begin() returns and stats_end() takes. */
+#define stats_begin(c) (stats_enabled && !(++stats_counters[c].count % STATS_SAMPLE) ? stats_now() : 0)
+#define stats_end(c, t) do { if(t) stats_record(c, t); } while(0)
+
+/* Adds n calls that took ns in total, measured elsewhere (in a thread) */
+void stats_add(int, uint64_t n, uint64_t ns);
+
+/* Starts a new phase, ending the current one */
+void stats_phase(int);
+
+/* Installs the SIGUSR1 handler, when the output isn't a curses UI */
+void stats_init(void);
+
+/* Prints everything to stderr */
+void stats_print(void);
+
+/* Prints the stats if SIGUSR1 asked for it, called while scanning */
+#define stats_poll() do { if(stats_requested) stats_print(); } while(0)
+
+#endif
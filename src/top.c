@@ -0,0 +1,444 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "global.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <ncurses.h>
+#include <khashl.h>
+
+
+/* The largest files and the directories with the largest own size (the size
+ * of the directory itself plus that of the files directly in it, ignoring its
+ * subdirectories), each kept in a bounded min-heap of TOP_K entries that is
+ * updated by the dir_output implementations as items come in. Entries refer
+ * to the item in memory (dir_mem.c), or have a copy of the path when there is
+ * no tree (dir_export.c). Items in the heaps have FF_TOP set. */
+static struct top_entry heaps[2][TOP_K];
+static int heaplen[2];
+
+/* Slot of every entry in its heap, by item in memory and, for hard links, by
+ * device and inode. These keep the lookups of top_forget() and the hard link
+ * check of heap_offer() from having to walk the heap. */
+struct top_ino {
+  uint64_t dev, ino;
+};
+#define ino_hash(k) (kh_hash_uint64((khint64_t)(k).dev) ^ kh_hash_uint64((khint64_t)(k).ino))
+#define ino_equal(a, b) ((a).dev == (b).dev && (a).ino == (b).ino)
+KHASHL_MAP_INIT(KH_LOCAL, ti_t, ti, struct top_ino, int, ino_hash, ino_equal)
+#define dir_hash(d) kh_hash_uint64((khint64_t)(uintptr_t)(d))
+KHASHL_MAP_INIT(KH_LOCAL, td_t, td, struct dir *, int, dir_hash, kh_eq_generic)
+static ti_t *byino[2];
+static td_t *bydir[2];
+
+/* Own size of every directory that is currently being read */
+static struct top_stack {
+  int64_t size;
+  struct dir *d;
+  unsigned int serial;
+  int links; /* start of its entries in link_list */
+} *stack;
+static int stack_len, stack_size;
+static unsigned int serial;
+
+/* Hard links seen in each directory, so that they only count once towards
+ * its own size. Keyed by the serial of the directory on the stack. Only the
+ * directory on top of the stack gets items, so the entries are also kept in
+ * link_list in stack order and removed when their directory is left. */
+struct top_link {
+  uint64_t dev, ino;
+  unsigned int serial;
+};
+#define link_hash(l) (kh_hash_uint64((khint64_t)(l).dev) ^ kh_hash_uint64((khint64_t)(l).ino) ^ kh_hash_uint32((l).serial))
+#define link_equal(a, b) ((a).dev == (b).dev && (a).ino == (b).ino && (a).serial == (b).serial)
+KHASHL_SET_INIT(KH_LOCAL, tl_t, tl, struct top_link, link_hash, link_equal)
+static tl_t *links;
+static struct top_link *link_list;
+static int link_len, link_size;
+
+/* The view */
+static struct top_entry *view;
+static int view_len, view_list, sel, vtop;
+
+
+/* Records that entry i of the list is in slot i */
+static void slot_set(int list, int i) {
+  struct top_entry *e = heaps[list]+i;
+  struct top_ino key;
+  khint_t k;
+  int absent;
+
+  if(e->d) {
+    if(!bydir[list])
+      bydir[list] = td_init();
+    k = td_put(bydir[list], e->d, &absent);
+    kh_val(bydir[list], k) = i;
+  }
+  if(e->ino) {
+    if(!byino[list])
+      byino[list] = ti_init();
+    key.dev = e->dev;
+    key.ino = e->ino;
+    k = ti_put(byino[list], key, &absent);
+    kh_val(byino[list], k) = i;
+  }
+}
+
+
+static void slot_del(int list, int i) {
+  struct top_entry *e = heaps[list]+i;
+  struct top_ino key;
+  khint_t k;
+
+  if(e->d && (k = td_get(bydir[list], e->d)) != kh_end(bydir[list]))
+    td_del(bydir[list], k);
+  if(e->ino) {
+    key.dev = e->dev;
+    key.ino = e->ino;
+    if((k = ti_get(byino[list], key)) != kh_end(byino[list]))
+      ti_del(byino[list], k);
+  }
+}
+
+
+static void heap_swap(int list, int a, int b) {
+  struct top_entry *h = heaps[list], t = h[a];
+  h[a] = h[b];
+  h[b] = t;
+  slot_set(list, a);
+  slot_set(list, b);
+}
+
+
+static void heap_down(int list, int i) {
+  struct top_entry *h = heaps[list];
+  int c, len = heaplen[list];
+  while((c = 2*i+1) < len) {
+    if(c+1 < len && h[c+1].size < h[c].size)
+      c++;
+    if(h[i].size <= h[c].size)
+      break;
+    heap_swap(list, i, c);
+    i = c;
+  }
+}
+
+
+static void heap_up(int list, int i) {
+  struct top_entry *h = heaps[list];
+  while(i > 0 && h[i].size < h[(i-1)/2].size) {
+    heap_swap(list, i, (i-1)/2);
+    i = (i-1)/2;
+  }
+}
+
+
+static void heap_remove(int list, int i) {
+  struct top_entry *h = heaps[list];
+  slot_del(list, i);
+  if(h[i].d)
+    h[i].d->flags &= ~FF_TOP;
+  free(h[i].path);
+  h[i] = h[--heaplen[list]];
+  if(i < heaplen[list]) {
+    slot_set(list, i);
+    heap_down(list, i);
+    heap_up(list, i);
+  }
+}
+
+
+static void heap_offer(int list, int64_t size, struct dir *d, uint64_t dev, uint64_t ino) {
+  struct top_entry *h = heaps[list];
+  struct top_ino key;
+  int i;
+
+  if(heaplen[list] == TOP_K && size <= h[0].size)
+    return;
+
+  /* hard links to the same file are only listed once */
+  key.dev = dev;
+  key.ino = ino;
+  if(ino && byino[list] && ti_get(byino[list], key) != kh_end(byino[list]))
+    return;
+  /* and an item only has one slot */
+  if(d && d->flags & FF_TOP)
+    top_forget(d);
+
+  if(heaplen[list] == TOP_K)
+    heap_remove(list, 0);
+  i = heaplen[list]++;
+  h[i].size = size;
+  h[i].dev = dev;
+  h[i].ino = ino;
+  h[i].d = d;
+  h[i].path = d ? NULL : xstrdup(dir_curpath);
+  if(d)
+    d->flags |= FF_TOP;
+  slot_set(list, i);
+  heap_up(list, i);
+}
+
+
+void top_reset(void) {
+  while(heaplen[TOP_FILES] > 0)
+    heap_remove(TOP_FILES, 0);
+  while(heaplen[TOP_DIRS] > 0)
+    heap_remove(TOP_DIRS, 0);
+  stack_len = 0;
+  link_len = 0;
+  if(links)
+    tl_s_clear(links);
+}
+
+
+static void pop(void) {
+  int n = stack[--stack_len].links;
+  khint_t k;
+  for(; link_len > n; link_len--)
+    if((k = tl_get(links, link_list[link_len-1])) != kh_end(links))
+      tl_del(links, k);
+}
+
+
+void top_item(struct dir *item, struct dir *d) {
+  struct top_link l;
+  int absent = 1;
+
+  if(item->flags & FF_DIR) {
+    if(stack_len >= stack_size) {
+      stack_size = stack_size ? stack_size*2 : 64;
+      stack = xrealloc(stack, stack_size*sizeof(*stack));
+    }
+    stack[stack_len].size = item->size;
+    stack[stack_len].serial = serial++;
+    stack[stack_len].links = link_len;
+    stack[stack_len++].d = d;
+    return;
+  }
+  if(stack_len > 0 && item->flags & FF_HLNKC) {
+    if(!links)
+      links = tl_init();
+    l.dev = item->dev;
+    l.ino = item->ino;
+    l.serial = stack[stack_len-1].serial;
+    tl_put(links, l, &absent);
+    if(absent) {
+      if(link_len == link_size) {
+        link_size = link_size ? link_size*2 : 64;
+        link_list = xrealloc(link_list, link_size*sizeof(*link_list));
+      }
+      link_list[link_len++] = l;
+    }
+  }
+  if(stack_len > 0 && absent)
+    stack[stack_len-1].size = adds64(stack[stack_len-1].size, item->size);
+  heap_offer(TOP_FILES, item->size, d, item->dev, item->flags & FF_HLNKC ? item->ino : 0);
+}
+
+
+void top_leave(void) {
+  if(stack_len > 0) {
+    pop();
+    heap_offer(TOP_DIRS, stack[stack_len].size, stack[stack_len].d, 0, 0);
+  }
+}
+
+
+void top_skip(void) {
+  if(stack_len > 0)
+    pop();
+}
+
+
+void top_dir(struct dir *d, int64_t own) {
+  top_forget(d);
+  heap_offer(TOP_DIRS, own, d, 0, 0);
+}
+
+
+void top_forget(struct dir *d) {
+  int list;
+  khint_t k;
+  for(list=0; list<2; list++)
+    if(bydir[list] && (k = td_get(bydir[list], d)) != kh_end(bydir[list])) {
+      heap_remove(list, kh_val(bydir[list], k));
+      return;
+    }
+}
+
+
+void top_forget_below(struct dir *d) {
+  struct top_entry *h;
+  struct dir *t;
+  int list, i, n;
+  for(list=0; list<2; list++) {
+    h = heaps[list];
+    for(i=n=0; i<heaplen[list]; i++) {
+      for(t=h[i].d; t && t != d; t=t->parent)
+        ;
+      if(t)
+        h[i].d->flags &= ~FF_TOP;
+      else
+        h[n++] = h[i];
+    }
+    heaplen[list] = n;
+    if(bydir[list])
+      td_m_clear(bydir[list]);
+    if(byino[list])
+      ti_m_clear(byino[list]);
+    for(i=0; i<n; i++)
+      slot_set(list, i);
+    for(i=n/2-1; i>=0; i--)
+      heap_down(list, i);
+  }
+}
+
+
+static int entry_cmp(const void *va, const void *vb) {
+  const struct top_entry *a = va, *b = vb;
+  return a->size > b->size ? -1 : a->size < b->size ? 1 : 0;
+}
+
+
+struct top_entry *top_sorted(int list, int *len) {
+  struct top_entry *l = xmalloc((heaplen[list] ? heaplen[list] : 1)*sizeof(*l));
+  memcpy(l, heaps[list], heaplen[list]*sizeof(*l));
+  qsort(l, heaplen[list], sizeof(*l), entry_cmp);
+  *len = heaplen[list];
+  return l;
+}
+
+
+static void view_open(int list) {
+  free(view);
+  view_list = list;
+  view = top_sorted(list, &view_len);
+  sel = vtop = 0;
+}
+
+
+void top_draw(void) {
+  int height = winrows-4, width = wincols-6, rows = height-6, i;
+  enum ui_coltype c;
+  struct top_entry *e;
+
+  browse_draw();
+  nccreate(height, width, "Largest items");
+
+  nctab(width-28, view_list == TOP_FILES, 1, "Files");
+  nctab(width-18, view_list == TOP_DIRS, 2, "Directories");
+  ncaddstr(2, 2, view_list == TOP_FILES ? "Largest files by disk usage" :
+    "Largest directories by the disk usage of the files directly in them");
+
+  for(i=0; i<rows && vtop+i < view_len; i++) {
+    e = view+vtop+i;
+    c = vtop+i == sel ? UIC_SEL : UIC_DEFAULT;
+    uic_set(c);
+    mvhline(subwinr+3+i, subwinc+1, ' ', width-2);
+    move(subwinr+3+i, subwinc+2);
+    printsize(c, e->size);
+    ncaddstrc(c, 3+i, 14, cropstr(getpath(e->d), width-16));
+  }
+
+  uic_set(UIC_DEFAULT);
+  if(!view_len)
+    ncaddstr(3, 2, "No items.");
+  ncaddstrc(UIC_KEY, height-2, width-30, "Enter");
+  addstrc(UIC_DEFAULT, " to open, ");
+  addstrc(UIC_KEY, "q");
+  addstrc(UIC_DEFAULT, " to close");
+}
+
+
+int top_key(int ch) {
+  int rows = winrows-10;
+  struct dir *d;
+
+  switch(ch) {
+  case '1':
+  case KEY_LEFT:
+  case 'h':
+    view_open(TOP_FILES);
+    break;
+  case '2':
+  case KEY_RIGHT:
+  case 'l':
+  case 9: /* tab */
+    view_open(ch == 9 ? !view_list : TOP_DIRS);
+    break;
+  case KEY_UP:
+  case 'k':
+    sel--;
+    break;
+  case KEY_DOWN:
+  case 'j':
+    sel++;
+    break;
+  case KEY_PPAGE:
+    sel -= rows;
+    break;
+  case KEY_NPAGE:
+    sel += rows;
+    break;
+  case KEY_HOME:
+    sel = 0;
+    break;
+  case KEY_END:
+    sel = view_len-1;
+    break;
+  case 10:
+  case KEY_ENTER:
+    if(!view_len)
+      break;
+    d = view[sel].d;
+    browse_init(d->parent ? d->parent : d);
+    if(dirlist_hidden && d->flags & FF_HIDN)
+      dirlist_set_hidden(0);
+    dirlist_select(d);
+    dirlist_top(-3);
+    return 0;
+  default:
+    pstate = ST_BROWSE;
+    return 0;
+  }
+
+  if(sel >= view_len)
+    sel = view_len-1;
+  if(sel < 0)
+    sel = 0;
+  if(sel < vtop)
+    vtop = sel;
+  if(sel >= vtop+rows)
+    vtop = sel-rows+1;
+  return 0;
+}
+
+
+void top_init(void) {
+  pstate = ST_TOP;
+  view_open(TOP_FILES);
+}
@@ -0,0 +1,73 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef _top_h
+#define _top_h
+
+#include "global.h"
+
+#define TOP_K     100
+#define TOP_FILES 0
+#define TOP_DIRS  1
+
+struct top_entry {
+  int64_t size;
+  uint64_t dev, ino;
+  struct dir *d; /* item in memory, or NULL if there's no tree */
+  char *path;    /* copy of dir_curpath when d is NULL */
+};
+
+/* Clears the lists, called before a new tree is built */
+void top_reset(void);
+
+/* To be called by the dir_output implementations for every item, with the
+ * item as given to item() and the copy in memory (or NULL), and for every
+ * item(NULL) call. */
+void top_item(struct dir *item, struct dir *d);
+void top_leave(void);
+
+/* Like top_leave(), when the contents of the directory come later, after it
+ * has been given to top_item() again */
+void top_skip(void);
+
+/* Replaces the size of a directory in the list with the given own size */
+void top_dir(struct dir *d, int64_t own);
+
+/* Removes an item that is about to be freed from the lists */
+void top_forget(struct dir *);
+
+/* Removes the given dir and everything below it from the lists */
+void top_forget_below(struct dir *);
+
+/* Returns a copy of the given list (TOP_FILES or TOP_DIRS) sorted by size,
+ * largest first, and sets *len to its length. Must be freed. */
+struct top_entry *top_sorted(int list, int *len);
+
+int  top_key(int);
+void top_draw(void);
+void top_init(void);
+
+
+#endif
@@ -0,0 +1,182 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "global.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+
+#define TRACE_BUF      (256*1024)
+#define TRACE_MAXPATH  4096
+#define TRACE_INTERVAL 10000000 /* ns between counter events */
+
+int trace_enabled = 0;
+
+static FILE *stream;
+static char *buf;
+static size_t len;
+static int first = 1;
+static uint64_t t_begin, t_progress;
+
+/* Protects everything above once tracing has started */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Small thread numbers for the timeline, in the order that threads show up */
+static pthread_key_t tid_key;
+static long tid_last;
+
+
+static void flush(void) {
+  if(len)
+    fwrite(buf, 1, len, stream);
+  len = 0;
+}
+
+
+/* Starts a new event, the caller has the lock */
+static void event(size_t need) {
+  if(len + need + 2 > TRACE_BUF)
+    flush();
+  if(!first)
+    buf[len++] = ',';
+  buf[len++] = '\n';
+  first = 0;
+}
+
+
+static void put_string(const char *s) {
+  int n;
+  buf[len++] = '"';
+  for(n=0; *s && n<TRACE_MAXPATH; s++, n++) {
+    if(*s == '"' || *s == '\\') {
+      buf[len++] = '\\';
+      buf[len++] = *s;
+    } else if((unsigned char)*s < 0x20)
+      len += sprintf(buf+len, "\\u%04x", *s);
+    else
+      buf[len++] = *s;
+  }
+  buf[len++] = '"';
+}
+
+
+/* Returns the number of the calling thread, the caller has the lock */
+static long tid(const char *name) {
+  long id = (long)(uintptr_t)pthread_getspecific(tid_key);
+  if(!id) {
+    id = ++tid_last;
+    pthread_setspecific(tid_key, (void *)(uintptr_t)id);
+  }
+  if(name) {
+    event(128 + strlen(name));
+    len += sprintf(buf+len, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%ld,\"args\":{\"name\":", id);
+    put_string(name);
+    buf[len++] = '}';
+    buf[len++] = '}';
+  }
+  return id;
+}
+
+
+int trace_open(const char *fn) {
+  if((stream = fopen(fn, "w")) == NULL)
+    return 0;
+  /* we do our own buffering */
+  setvbuf(stream, NULL, _IONBF, 0);
+  buf = xmalloc(TRACE_BUF);
+  fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", stream);
+  pthread_key_create(&tid_key, NULL);
+  t_begin = stats_now();
+  trace_enabled = 1;
+  tid("main");
+  return 1;
+}
+
+
+void trace_close(void) {
+  if(!trace_enabled)
+    return;
+  pthread_mutex_lock(&lock);
+  trace_enabled = 0;
+  flush();
+  fputs("\n]}\n", stream);
+  fclose(stream);
+  free(buf);
+  pthread_mutex_unlock(&lock);
+}
+
+
+void trace_span(const char *name, uint64_t start, const char *path, int64_t count) {
+  uint64_t end = stats_now();
+  long id;
+
+  if(!start)
+    return;
+  pthread_mutex_lock(&lock);
+  if(trace_enabled) {
+    id = tid(NULL);
+    event(256 + (path ? 6*TRACE_MAXPATH : 0));
+    len += sprintf(buf+len, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f",
+      name, id, (start - t_begin) / 1e3, (end - start) / 1e3);
+    if(path || count >= 0) {
+      len += sprintf(buf+len, ",\"args\":{");
+      if(path) {
+        len += sprintf(buf+len, "\"path\":");
+        put_string(path);
+      }
+      if(count >= 0)
+        len += sprintf(buf+len, "%s\"count\":%"PRId64, path ? "," : "", count);
+      buf[len++] = '}';
+    }
+    buf[len++] = '}';
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+
+void trace_thread(const char *name) {
+  if(!trace_enabled)
+    return;
+  pthread_mutex_lock(&lock);
+  if(trace_enabled)
+    tid(name);
+  pthread_mutex_unlock(&lock);
+}
+
+
+void trace_progress(void) {
+  uint64_t now;
+
+  if(!trace_enabled || (now = stats_now()) - t_progress < TRACE_INTERVAL)
+    return;
+  t_progress = now;
+  pthread_mutex_lock(&lock);
+  event(256);
+  len += sprintf(buf+len, "{\"name\":\"progress\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"items\":%"PRId64",\"bytes\":%"PRId64"}}",
+    (now - t_begin) / 1e3, (int64_t)dir_output.items, dir_output.size);
+  pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,57 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef _trace_h
+#define _trace_h
+
+#include "global.h"
+
+/* --trace, a timeline of the scan, import, sorting and deleting in the Chrome
+ * trace event format, which can be loaded in Perfetto or chrome://tracing.
+ * Events are buffered and written in large blocks. */
+extern int trace_enabled;
+
+/* Returns 0 if the file couldn't be opened */
+int trace_open(const char *fn);
+
+/* Writes the end of the file and closes it */
+void trace_close(void);
+
+/* Start of a span, 0 when tracing is disabled */
+#define trace_begin() (trace_enabled ? stats_now() : 0)
+
+/* Records a span from start until now, with an optional path and count (-1
+ * to leave it out). Does nothing if start is 0. Can be called from any
+ * thread. */
+void trace_span(const char *name, uint64_t start, const char *path, int64_t count);
+
+/* Names the calling thread in the timeline */
+void trace_thread(const char *name);
+
+/* Records the number of items and bytes of dir_output, at most once every few
+ * milliseconds, called while scanning */
+void trace_progress(void);
+
+#endif
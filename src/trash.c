@@ -0,0 +1,374 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "global.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <ncurses.h>
+#include <sys/stat.h>
+
+
+/* Background deletion. An item is deleted by renaming it into TRASH_NAME in
+ * the top directory of its filesystem within the scanned tree, which is
+ * instant, and removing it from the tree right away. A single thread then
+ * deletes the contents of the trash while the user continues browsing.
+ *
+ * Trash directories left over from an interrupted run are deleted after the
+ * scan when the user agrees. Only directories that look like ours are
+ * offered: at the top of a filesystem, and with nothing but <pid>.<serial>
+ * entries in them. */
+
+int trash_enabled = 0;
+
+struct trash_job {
+  char *path;
+  struct trash_job *next;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+static struct trash_job *queue, *queue_last;
+static int running, busy, errors, serial;
+static long deleted;
+static char *lasterr;
+
+/* Trash directories that have been used or queued for cleanup in this
+ * session */
+static char **seen;
+static int seen_len;
+
+/* Leftover trash directories waiting for the user's answer */
+static struct dir **found;
+static int found_len, found_size;
+
+
+static void job_add(char *path) {
+  struct trash_job *j = xmalloc(sizeof(struct trash_job));
+  if(!busy) {
+    errors = 0;
+    deleted = 0;
+  }
+  j->path = path;
+  j->next = NULL;
+  if(queue_last)
+    queue_last->next = j;
+  else
+    queue = j;
+  queue_last = j;
+  busy++;
+  pthread_cond_signal(&work);
+}
+
+
+static void seterr(const char *path, int err) {
+  char buf[1024];
+  snprintf(buf, sizeof(buf), "%s: %s", path, strerror(err));
+  pthread_mutex_lock(&lock);
+  free(lasterr);
+  lasterr = xstrdup(buf);
+  errors++;
+  pthread_mutex_unlock(&lock);
+}
+
+
+/* Deletes name relative to pfd and everything below it, isdir tells whether
+ * it's known to be a directory. Errors are reported with the path of the job,
+ * items that have already disappeared are not an error. */
+static void rm_tree(int pfd, const char *name, int isdir, const char *path) {
+  struct dirent *ent;
+  DIR *dir;
+  int fd;
+  long n = 0;
+
+  if(!isdir && (unlinkat(pfd, name, 0) == 0 || errno == ENOENT))
+    n++;
+  else if(!isdir && errno != EISDIR && errno != EPERM)
+    seterr(path, errno);
+  else if((fd = openat(pfd, name, O_RDONLY|O_DIRECTORY|O_NOFOLLOW)) < 0) {
+    if(errno != ENOENT)
+      seterr(path, errno);
+  } else if(!(dir = fdopendir(fd))) {
+    seterr(path, errno);
+    close(fd);
+  } else {
+    while((ent = readdir(dir)) != NULL) {
+      if(ent->d_name[0] == '.' && (!ent->d_name[1] || (ent->d_name[1] == '.' && !ent->d_name[2])))
+        continue;
+      if(ent->d_type == DT_DIR)
+        rm_tree(fd, ent->d_name, 1, path);
+      else if(unlinkat(fd, ent->d_name, 0) == 0 || errno == ENOENT)
+        n++;
+      else
+        rm_tree(fd, ent->d_name, 0, path);
+    }
+    closedir(dir);
+    if(unlinkat(pfd, name, AT_REMOVEDIR) == 0 || errno == ENOENT)
+      n++;
+    else
+      seterr(path, errno);
+  }
+
+  pthread_mutex_lock(&lock);
+  deleted += n;
+  pthread_mutex_unlock(&lock);
+}
+
+
+static void *worker(void *arg) {
+  struct trash_job *j;
+  char *p;
+
+  pthread_mutex_lock(&lock);
+  while(1) {
+    while(!queue)
+      pthread_cond_wait(&work, &lock);
+    j = queue;
+    if(!(queue = j->next))
+      queue_last = NULL;
+    pthread_mutex_unlock(&lock);
+
+    rm_tree(AT_FDCWD, j->path, 0, j->path);
+    /* remove the trash directory itself once it's empty */
+    if((p = strrchr(j->path, '/')) != NULL && strcmp(p+1, TRASH_NAME) != 0) {
+      *p = 0;
+      rmdir(j->path);
+    }
+    free(j->path);
+    free(j);
+
+    pthread_mutex_lock(&lock);
+    busy--;
+  }
+  return arg;
+}
+
+
+static void start(void) {
+  pthread_t t;
+  if(running)
+    return;
+  running = pthread_create(&t, NULL, worker, NULL) == 0;
+  if(running)
+    pthread_detach(t);
+}
+
+
+static int seen_has(const char *path) {
+  int i;
+  for(i=0; i<seen_len; i++)
+    if(strcmp(seen[i], path) == 0)
+      return 1;
+  return 0;
+}
+
+
+static int seen_add(const char *path) {
+  if(seen_has(path))
+    return 0;
+  seen = xrealloc(seen, (seen_len+1)*sizeof(*seen));
+  seen[seen_len++] = xstrdup(path);
+  return 1;
+}
+
+
+int trash_move(struct dir *d) {
+  struct dir *top;
+  char *trash, *dest;
+  size_t len;
+  int r, tries = 0;
+
+  for(top=d->parent; top->parent && top->parent->dev == d->dev; top=top->parent)
+    ;
+  len = strlen(getpath(top));
+  trash = xmalloc(len + sizeof(TRASH_NAME) + 2);
+  sprintf(trash, "%s/%s", len == 1 ? "" : getpath(top), TRASH_NAME);
+  dest = xmalloc(strlen(trash) + 32);
+  sprintf(dest, "%s/%d.%d", trash, (int)getpid(), ++serial);
+
+  /* the worker removes the trash directory when it's empty, so try again if
+   * that happened in between */
+  do
+    r = (mkdir(trash, 0700) < 0 && errno != EEXIST) || rename(getpath(d), dest) < 0;
+  while(r && errno == ENOENT && ++tries < 3);
+  if(r) {
+    free(trash);
+    free(dest);
+    return -1;
+  }
+  /* the trash we're using isn't left over from an earlier run */
+  seen_add(trash);
+  free(trash);
+
+  pthread_mutex_lock(&lock);
+  start();
+  if(!running) {
+    pthread_mutex_unlock(&lock);
+    free(dest);
+    errno = EAGAIN;
+    return -1;
+  }
+  job_add(dest);
+  pthread_mutex_unlock(&lock);
+  freedir(d);
+  return 0;
+}
+
+
+static void cleanup(const char *path) {
+  if(!seen_add(path))
+    return;
+
+  pthread_mutex_lock(&lock);
+  start();
+  if(running)
+    job_add(xstrdup(path));
+  pthread_mutex_unlock(&lock);
+}
+
+
+int trash_ignored(const char *path) {
+  return seen_has(path);
+}
+
+
+/* Whether d is a trash directory as made by trash_move() */
+static int is_leftover(struct dir *d) {
+  struct dir *t;
+  const char *c;
+
+  if(!(d->flags & FF_DIR) || d->flags & (FF_ERR|FF_SERR|FF_EXL|FF_OTHFS|FF_KERNFS|FF_FRMLNK)
+      || strcmp(d->name, TRASH_NAME) != 0 || !d->sub || d->dev != d->parent->dev)
+    return 0;
+  for(t=d->sub; t; t=t->next) {
+    c = t->name;
+    if(*c < '0' || *c > '9')
+      return 0;
+    while(*c >= '0' && *c <= '9')
+      c++;
+    if(*c++ != '.' || *c < '0' || *c > '9')
+      return 0;
+    while(*c >= '0' && *c <= '9')
+      c++;
+    if(*c)
+      return 0;
+  }
+  return !seen_has(getpath(d));
+}
+
+
+static void find(struct dir *d) {
+  struct dir *t;
+  /* trash_move() only uses the top directory of a filesystem */
+  int top = !d->parent || d->parent->dev != d->dev;
+
+  for(t=d->sub; t; t=t->next) {
+    if(!(t->flags & FF_DIR))
+      continue;
+    if(top && is_leftover(t)) {
+      if(found_len == found_size) {
+        found_size = found_size ? found_size*2 : 4;
+        found = xrealloc(found, found_size*sizeof(*found));
+      }
+      found[found_len++] = t;
+    } else
+      find(t);
+  }
+}
+
+
+void trash_check(struct dir *root) {
+  if(!trash_enabled)
+    return;
+  found_len = 0;
+  find(root);
+  if(found_len)
+    pstate = ST_TRASH;
+}
+
+
+void trash_draw(void) {
+  browse_draw();
+  nccreate(7, 60, "Leftover trash");
+  if(found_len == 1)
+    ncprint(1, 2, "Found a trash directory from an interrupted run:");
+  else
+    ncprint(1, 2, "Found %d trash directories from an interrupted run:", found_len);
+  ncaddstr(2, 4, cropstr(getpath(found[0]), 54));
+  if(found_len > 1)
+    ncprint(3, 4, "and %d more", found_len-1);
+  ncaddstr(5, 2, "Delete their contents in the background? (y/N)");
+}
+
+
+int trash_key(int ch) {
+  struct dir *d, *t;
+  int i;
+
+  if(ch == 'y' || ch == 'Y') {
+    d = dirlist_par;
+    for(i=0; i<found_len; i++) {
+      cleanup(getpath(found[i]));
+      /* don't leave the browser in a directory that's about to be freed */
+      for(t=d; t; t=t->parent)
+        if(t == found[i])
+          d = found[i]->parent;
+      freedir(found[i]);
+    }
+    found_len = 0;
+    browse_init(d);
+    return 0;
+  }
+  found_len = 0;
+  pstate = ST_BROWSE;
+  return 0;
+}
+
+
+int trash_busy(void) {
+  int r;
+  pthread_mutex_lock(&lock);
+  r = busy;
+  pthread_mutex_unlock(&lock);
+  return r;
+}
+
+
+void trash_status(char *buf, int len) {
+  pthread_mutex_lock(&lock);
+  if(errors && !busy)
+    snprintf(buf, len, "%d error%s deleting, last: %s", errors, errors == 1 ? "" : "s", lasterr);
+  else if(busy)
+    snprintf(buf, len, "Deleting in the background: %ld items%s", deleted, errors ? ", with errors" : "");
+  else
+    buf[0] = 0;
+  pthread_mutex_unlock(&lock);
+}
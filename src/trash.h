@@ -0,0 +1,59 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef _trash_h
+#define _trash_h
+
+#include "global.h"
+
+#define TRASH_NAME ".ncdu-trash"
+
+/* Whether deleted items are moved to the trash and deleted in the background */
+extern int trash_enabled;
+
+/* Renames the item into the trash directory of its filesystem, removes it
+ * from the tree and queues it for deletion. Returns -1 and sets errno when the
+ * item couldn't be moved, in which case the tree is left alone. */
+int trash_move(struct dir *);
+
+/* Whether path is a trash directory that is used in this session, the
+ * scanner leaves these out so that deleted items don't come back. Leftovers
+ * from an earlier run are not ignored. */
+int trash_ignored(const char *);
+
+/* Looks for trash directories left over from an interrupted run in a newly
+ * scanned tree, and asks whether to delete them if there are any */
+void trash_check(struct dir *);
+void trash_draw(void);
+int trash_key(int);
+
+/* Returns whether there's work left for the background thread */
+int trash_busy(void);
+
+/* Writes a short status message for the bottom line to buf, or an empty
+ * string if there's nothing to report */
+void trash_status(char *buf, int len);
+
+#endif
@@ -0,0 +1,191 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "global.h"
+
+#include <stdlib.h>
+
+#if defined(HAVE_LINUX_IO_URING_H) && HAVE_DECL_IORING_OP_UNLINKAT
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+
+/* A minimal io_uring setup with the raw system calls, just enough to submit a
+ * batch of IORING_OP_UNLINKAT requests and wait for all of them. */
+struct uring {
+  int fd;
+  void *sq_ptr, *cq_ptr;
+  size_t sq_size, cq_size, sqes_size;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+};
+
+
+static int supported(int fd) {
+  struct io_uring_probe *p;
+  size_t len = sizeof(struct io_uring_probe) + 256*sizeof(struct io_uring_probe_op);
+  int r;
+
+  p = xcalloc(1, len);
+  r = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, p, 256) == 0
+    && p->last_op >= IORING_OP_UNLINKAT
+    && p->ops[IORING_OP_UNLINKAT].flags & IO_URING_OP_SUPPORTED;
+  free(p);
+  return r;
+}
+
+
+struct uring *uring_open(void) {
+  struct io_uring_params p;
+  struct uring *u;
+  char *sq, *cq;
+
+  memset(&p, 0, sizeof(p));
+  u = xcalloc(1, sizeof(struct uring));
+  if((u->fd = syscall(__NR_io_uring_setup, URING_BATCH, &p)) < 0) {
+    free(u);
+    return NULL;
+  }
+  if(!supported(u->fd) || p.sq_entries < URING_BATCH) {
+    close(u->fd);
+    free(u);
+    return NULL;
+  }
+
+  u->sq_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+  u->cq_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+  if(p.features & IORING_FEAT_SINGLE_MMAP && u->cq_size > u->sq_size)
+    u->sq_size = u->cq_size;
+  u->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+
+  u->sq_ptr = mmap(NULL, u->sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  u->cq_ptr = p.features & IORING_FEAT_SINGLE_MMAP ? u->sq_ptr :
+    mmap(NULL, u->cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+  u->sqes = mmap(NULL, u->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQES);
+  if(u->sq_ptr == MAP_FAILED || u->cq_ptr == MAP_FAILED || u->sqes == MAP_FAILED) {
+    uring_close(u);
+    return NULL;
+  }
+
+  sq = u->sq_ptr;
+  cq = u->cq_ptr;
+  u->sq_head  = (unsigned *)(sq + p.sq_off.head);
+  u->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+  u->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+  u->sq_array = (unsigned *)(sq + p.sq_off.array);
+  u->cq_head  = (unsigned *)(cq + p.cq_off.head);
+  u->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+  u->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+  u->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return u;
+}
+
+
+void uring_close(struct uring *u) {
+  if(!u)
+    return;
+  if(u->sqes && u->sqes != MAP_FAILED)
+    munmap(u->sqes, u->sqes_size);
+  if(u->cq_ptr && u->cq_ptr != MAP_FAILED && u->cq_ptr != u->sq_ptr)
+    munmap(u->cq_ptr, u->cq_size);
+  if(u->sq_ptr && u->sq_ptr != MAP_FAILED)
+    munmap(u->sq_ptr, u->sq_size);
+  close(u->fd);
+  free(u);
+}
+
+
+int uring_unlink(struct uring *u, int dirfd, const char **names, int n, int *res) {
+  struct io_uring_sqe *sqe;
+  struct io_uring_cqe *cqe;
+  unsigned tail, head;
+  int i, sub = 0, done = 0, r;
+
+  tail = *u->sq_tail;
+  for(i=0; i<n; i++) {
+    sqe = u->sqes + (tail & *u->sq_mask);
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_UNLINKAT;
+    sqe->fd = dirfd;
+    sqe->addr = (unsigned long)names[i];
+    sqe->user_data = i;
+    u->sq_array[tail & *u->sq_mask] = tail & *u->sq_mask;
+    tail++;
+  }
+  __atomic_store_n(u->sq_tail, tail, __ATOMIC_RELEASE);
+
+  /* The kernel doesn't wait after a short submit, so the entries it didn't
+   * take are submitted again with the next call. If it takes none at all,
+   * they are taken off the ring and done with unlinkat() instead. */
+  while(done < n) {
+    r = syscall(__NR_io_uring_enter, u->fd, n-sub, n-done, IORING_ENTER_GETEVENTS, NULL, 0);
+    if(r > 0 && sub < n)
+      sub += r;
+    else if(sub < n && (r == 0 || errno != EINTR)) {
+      __atomic_store_n(u->sq_tail, tail - (n-sub), __ATOMIC_RELEASE);
+      if(!sub)
+        return -1;
+      for(i=sub; i<n; i++)
+        res[i] = unlinkat(dirfd, names[i], 0) == 0 ? 0 : errno;
+      n = sub;
+    } else if(r < 0 && errno != EINTR)
+      return -1;
+    head = *u->cq_head;
+    while(head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+      cqe = u->cqes + (head & *u->cq_mask);
+      res[cqe->user_data] = cqe->res < 0 ? -cqe->res : 0;
+      head++;
+      done++;
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+  }
+  return 0;
+}
+
+#else
+
+struct uring *uring_open(void) {
+  return NULL;
+}
+
+
+void uring_close(struct uring *u) {
+  free(u);
+}
+
+
+int uring_unlink(struct uring *u, int dirfd, const char **names, int n, int *res) {
+  (void)u; (void)dirfd; (void)names; (void)n; (void)res;
+  return -1;
+}
+
+#endif
@@ -0,0 +1,44 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef _uring_h
+#define _uring_h
+
+#include "global.h"
+
+/* Batched unlinkat() calls through io_uring, if the kernel supports it */
+struct uring;
+
+/* Returns NULL when io_uring or IORING_OP_UNLINKAT isn't available */
+struct uring *uring_open(void);
+void uring_close(struct uring *);
+
+/* Unlinks the n (at most URING_BATCH) files names[] relative to dirfd and
+ * sets res[i] to 0 or an errno value. Returns -1 if the ring has failed, in
+ * which case it should be closed and nothing can be assumed about the files. */
+#define URING_BATCH 256
+int uring_unlink(struct uring *, int dirfd, const char **names, int n, int *res);
+
+#endif
@@ -189,10 +189,13 @@ int ncresize(int minrows, int mincols) {
       endwin();
       exit(0);
     }
-    if(ch == 'i')
+    if(ch == 'i') {
+      browse_damage(0, winrows);
       return 1;
+    }
   }
   erase();
+  browse_damage(0, winrows);
   return 0;
 }
 
@@ -203,6 +206,7 @@ void nccreate(int height, int width, const char *title) {
   uic_set(UIC_DEFAULT);
   subwinr = winrows/2-height/2;
   subwinc = wincols/2-width/2;
+  browse_damage(subwinr, height);
 
   /* clear window */
   for(i=0; i<height; i++)
@@ -319,7 +323,7 @@ static void freedir_hlnk(struct dir *d) {
             i=0;
     if(i) {
       par->size = adds64(par->size, -d->size);
-      par->asize = adds64(par->size, -d->asize);
+      par->asize = adds64(par->asize, -d->asize);
     }
   }
 
@@ -337,6 +341,14 @@ static void freedir_rec(struct dir *dr) {
   tmp2 = dr;
   while((tmp = tmp2) != NULL) {
     freedir_hlnk(tmp);
+    if(tmp->flags & FF_DIR) {
+      dirlist_forget(tmp);
+      stamp_forget(tmp);
+    }
+    if(tmp->flags & FF_TOP)
+      top_forget(tmp);
+    if(tmp->flags & FF_MARK)
+      mark_forget(tmp);
     /* remove item */
     if(tmp->sub) freedir_rec(tmp->sub);
     tmp2 = tmp->next;
@@ -345,10 +357,16 @@ static void freedir_rec(struct dir *dr) {
 }
 
 
-void freedir(struct dir *dr) {
+static void freedir_item(struct dir *dr, int64_t *size, int64_t *asize) {
   if(!dr)
     return;
 
+  /* the search index may refer to any of the items below, and the usage
+   * tables include them */
+  search_invalidate();
+  agg_invalidate();
+  mark_invalidate();
+
   /* free dr->sub recursively */
   if(dr->sub)
     freedir_rec(dr->sub);
@@ -368,12 +386,35 @@ void freedir(struct dir *dr) {
    *
    * mtime is 0 here because recalculating the maximum at every parent
    * dir is expensive, but might be good feature to add later if desired */
-  addparentstats(dr->parent, dr->flags & FF_HLNKC ? 0 : -dr->size, dr->flags & FF_HLNKC ? 0 : -dr->asize, 0, -(dr->items+1));
+  if(!size)
+    addparentstats(dr->parent, dr->flags & FF_HLNKC ? 0 : -dr->size, dr->flags & FF_HLNKC ? 0 : -dr->asize, 0, -(dr->items+1));
+  else if(!(dr->flags & FF_HLNKC)) {
+    *size += dr->size;
+    *asize += dr->asize;
+  }
 
+  if(dr->flags & FF_DIR) {
+    dirlist_forget(dr);
+    stamp_forget(dr);
+  }
+  if(dr->flags & FF_TOP)
+    top_forget(dr);
+  if(dr->flags & FF_MARK)
+    mark_forget(dr);
   free(dr);
 }
 
 
+void freedir(struct dir *dr) {
+  freedir_item(dr, NULL, NULL);
+}
+
+
+void freedir_deferred(struct dir *dr, int64_t *size, int64_t *asize) {
+  freedir_item(dr, size, asize);
+}
+
+
 const char *getpath(struct dir *cur) {
   static char *dat;
   static int datl = 0;
@@ -422,6 +463,9 @@ struct dir *getroot(struct dir *d) {
 
 void addparentstats(struct dir *d, int64_t size, int64_t asize, uint64_t mtime, int items) {
   struct dir_ext *e;
+  uint64_t t = stats_begin(STAT_PARENTS);
+  /* the sort order of these directories may have changed */
+  dirlist_invalidate(d);
   while(d) {
     d->size = adds64(d->size, size);
     d->asize = adds64(d->asize, asize);
@@ -432,6 +476,7 @@ void addparentstats(struct dir *d, int64_t size, int64_t asize, uint64_t mtime,
     }
     d = d->parent;
   }
+  stats_end(STAT_PARENTS, t);
 }
 
 
@@ -143,6 +143,11 @@ void read_locale(void);
 /* recursively free()s a directory tree */
 void freedir(struct dir *);
 
+/* same, but leaves the sizes and item counts of the parent directories to the
+ * caller. The sizes that still have to be subtracted from them are added to
+ * *size and *asize, the item count is the item's items+1. */
+void freedir_deferred(struct dir *, int64_t *size, int64_t *asize);
+
 /* generates full path from a dir item,
    returned pointer will be overwritten with a subsequent call */
 const char *getpath(struct dir *);
@@ -0,0 +1,519 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "global.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+#if HAVE_SYS_FANOTIFY_H && HAVE_DECL_FAN_REPORT_DFID_NAME && HAVE_SYS_STATFS_H
+#include <sys/fanotify.h>
+#include <sys/statfs.h>
+#define USE_FANOTIFY 1
+#endif
+
+#include <khashl.h>
+
+
+int watch_enabled = 0;
+
+/* Minimum time between two rounds of updates, and between two checks of the
+ * whole tree when changes can't be watched, in ms */
+#define WATCH_DELAY 1000
+#define WATCH_POLL 30000
+
+/* Above this many pending directories, checking the whole tree is cheaper */
+#define WATCH_MAXPENDING 1024
+
+/* Reads of the event queue per call, a busy filesystem can keep it filled */
+#define WATCH_MAXREADS 64
+
+#define W_NONE     0
+#define W_INOTIFY  1
+#define W_FANOTIFY 2
+#define W_POLL     3 /* no notifications, periodically check the stamps */
+
+static int mode = W_NONE;
+static char *top;         /* root of the tree, see watch_root() */
+static int64_t lastapply, lastpoll;
+static int pollall;       /* the whole tree needs to be checked */
+static unsigned int added;
+
+/* Directories in which something changed, by absolute path */
+KHASHL_SET_INIT(KH_LOCAL, ps_t, ps, char *, kh_hash_str, kh_eq_str)
+static ps_t *pending;
+
+#define KH_FOREACH(h, k) for((k)=0; (k)<kh_end(h); (k)++) if(__kh_used((h)->used, (k)))
+
+#if HAVE_SYS_INOTIFY_H || USE_FANOTIFY
+static int fd = -1;       /* notification descriptor */
+#endif
+
+#if HAVE_SYS_INOTIFY_H
+#define IN_MASK (IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_MODIFY|IN_ATTRIB\
+  |IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR|IN_DONT_FOLLOW)
+
+/* Watched directories by watch descriptor */
+KHASHL_MAP_INIT(KH_LOCAL, wd_t, wd, int, char *, kh_hash_uint32, kh_eq_generic)
+static wd_t *watches;
+#endif
+
+#if USE_FANOTIFY
+#define FAN_MASK (FAN_CREATE|FAN_DELETE|FAN_MOVED_FROM|FAN_MOVED_TO|FAN_MODIFY|FAN_ATTRIB|FAN_ONDIR)
+
+/* Marked filesystems, with a descriptor to resolve file handles against */
+static struct fsmark {
+  uint64_t dev;
+  fsid_t fsid;
+  int mfd;
+} *marks;
+static int nmarks;
+
+/* Last resolved directory handle, events often come in bunches */
+static unsigned char lasthandle[MAX_HANDLE_SZ+sizeof(struct file_handle)];
+static size_t lasthandle_len;
+static char *lastpath;
+#endif
+
+
+static int64_t now_ms(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec*1000 + tv.tv_usec/1000;
+}
+
+
+static void pending_clear(void) {
+  khint_t k;
+  KH_FOREACH(pending, k)
+    free(kh_key(pending, k));
+  ps_s_clear(pending);
+}
+
+
+#if HAVE_SYS_INOTIFY_H || USE_FANOTIFY
+/* Adds the directory of len bytes at path to the pending set, when it's in
+ * the scanned tree */
+static void pending_add(const char *path, size_t len) {
+  size_t tlen = top ? strlen(top) : 0;
+  char *p;
+  int absent;
+
+  if(pollall)
+    return;
+  if(tlen > 1 && (len < tlen || strncmp(path, top, tlen) != 0 || (len > tlen && path[tlen] != '/')))
+    return;
+  if(kh_size(pending) >= WATCH_MAXPENDING) {
+    pending_clear();
+    pollall = 1;
+    return;
+  }
+  p = xmalloc(len+1);
+  memcpy(p, path, len);
+  p[len] = 0;
+  ps_put(pending, p, &absent);
+  if(!absent)
+    free(p);
+}
+
+
+/* The kernel can't tell us about changes anymore, check the stamps of the
+ * whole tree every now and then instead */
+static void fallback(void) {
+#if HAVE_SYS_INOTIFY_H
+  khint_t k;
+  if(watches) {
+    KH_FOREACH(watches, k)
+      free(kh_val(watches, k));
+    wd_destroy(watches);
+    watches = NULL;
+  }
+#endif
+#if USE_FANOTIFY
+  while(nmarks > 0)
+    close(marks[--nmarks].mfd);
+#endif
+  if(fd >= 0)
+    close(fd);
+  fd = -1;
+  mode = W_POLL;
+  lastpoll = now_ms();
+  pollall = 1;
+}
+#endif
+
+
+static void start(void) {
+  pending = ps_init();
+  mode = W_POLL;
+#if USE_FANOTIFY
+  if((fd = fanotify_init(FAN_CLASS_NOTIF|FAN_REPORT_DFID_NAME|FAN_NONBLOCK|FAN_CLOEXEC, O_RDONLY)) >= 0) {
+    mode = W_FANOTIFY;
+    return;
+  }
+#endif
+#if HAVE_SYS_INOTIFY_H
+  if((fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC)) >= 0) {
+    watches = wd_init();
+    mode = W_INOTIFY;
+  }
+#endif
+}
+
+
+#if HAVE_SYS_INOTIFY_H
+static void inotify_dir(const char *path) {
+  int w, absent;
+  khint_t k;
+
+  if((w = inotify_add_watch(fd, path, IN_MASK)) < 0) {
+    if(errno == ENOSPC || errno == ENOMEM)
+      fallback();
+    return;
+  }
+  /* a directory that was moved keeps its watch descriptor */
+  k = wd_put(watches, w, &absent);
+  if(!absent)
+    free(kh_val(watches, k));
+  kh_val(watches, k) = xstrdup(path);
+}
+
+
+static void inotify_read(void) {
+  union {
+    struct inotify_event ev;
+    char buf[4096];
+  } b;
+  struct inotify_event *ev;
+  ssize_t len;
+  char *p, *path, *sep;
+  khint_t k;
+  int i;
+
+  for(i=0; i<WATCH_MAXREADS && (len = read(fd, b.buf, sizeof(b.buf))) > 0; i++) {
+    for(p=b.buf; p<b.buf+len; p+=sizeof(struct inotify_event)+ev->len) {
+      ev = (struct inotify_event *)p;
+      if(ev->mask & IN_Q_OVERFLOW) {
+        pending_clear();
+        pollall = 1;
+        continue;
+      }
+      if((k = wd_get(watches, ev->wd)) == kh_end(watches))
+        continue;
+      path = kh_val(watches, k);
+      if(ev->mask & IN_IGNORED) {
+        free(path);
+        wd_del(watches, k);
+      } else if(ev->mask & (IN_DELETE_SELF|IN_MOVE_SELF)) {
+        if((sep = strrchr(path, '/')) != NULL)
+          pending_add(path, sep > path ? (size_t)(sep-path) : 1);
+      } else
+        pending_add(path, strlen(path));
+    }
+  }
+}
+#endif
+
+
+#if USE_FANOTIFY
+static void fanotify_dir(const char *path, uint64_t dev) {
+  struct statfs fs;
+  int i, mfd;
+
+  for(i=0; i<nmarks; i++)
+    if(marks[i].dev == dev)
+      return;
+
+  if((mfd = open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC)) < 0)
+    return;
+  if(fstatfs(mfd, &fs) || fanotify_mark(fd, FAN_MARK_ADD|FAN_MARK_FILESYSTEM, FAN_MASK, AT_FDCWD, path)) {
+    close(mfd);
+    /* not supported for the filesystem we started on, no harm in trying
+     * inotify instead */
+#if HAVE_SYS_INOTIFY_H
+    if(nmarks == 0 && (i = inotify_init1(IN_NONBLOCK|IN_CLOEXEC)) >= 0) {
+      close(fd);
+      fd = i;
+      watches = wd_init();
+      mode = W_INOTIFY;
+      inotify_dir(path);
+      return;
+    }
+#endif
+    fallback();
+    return;
+  }
+
+  marks = xrealloc(marks, (nmarks+1)*sizeof(*marks));
+  marks[nmarks].dev = dev;
+  marks[nmarks].fsid = fs.f_fsid;
+  marks[nmarks].mfd = mfd;
+  nmarks++;
+}
+
+
+/* Returns the path of the directory referenced by a file handle, or NULL */
+static const char *fanotify_path(const fsid_t *fsid, struct file_handle *fh) {
+  static char buf[64];
+  char path[PATH_MAX];
+  size_t len = sizeof(struct file_handle) + fh->handle_bytes;
+  ssize_t n;
+  int i, dfd;
+
+  if(len <= sizeof(lasthandle) && len == lasthandle_len && memcmp(lasthandle, fh, len) == 0)
+    return lastpath;
+
+  for(i=0; i<nmarks; i++)
+    if(memcmp(&marks[i].fsid, fsid, sizeof(fsid_t)) == 0)
+      break;
+  if(i == nmarks || (dfd = open_by_handle_at(marks[i].mfd, fh, O_PATH|O_CLOEXEC)) < 0)
+    return NULL;
+  snprintf(buf, sizeof(buf), "/proc/self/fd/%d", dfd);
+  n = readlink(buf, path, sizeof(path)-1);
+  close(dfd);
+  if(n <= 0)
+    return NULL;
+  path[n] = 0;
+
+  free(lastpath);
+  lastpath = xstrdup(path);
+  lasthandle_len = len <= sizeof(lasthandle) ? len : 0;
+  memcpy(lasthandle, fh, lasthandle_len);
+  return lastpath;
+}
+
+
+static void fanotify_read(void) {
+  union {
+    struct fanotify_event_metadata ev;
+    char buf[8192];
+  } b;
+  struct fanotify_event_metadata *ev;
+  struct fanotify_event_info_fid *fid;
+  const char *path;
+  ssize_t len;
+  int i;
+
+  for(i=0; i<WATCH_MAXREADS && (len = read(fd, b.buf, sizeof(b.buf))) > 0; i++) {
+    for(ev=&b.ev; FAN_EVENT_OK(ev, len); ev=FAN_EVENT_NEXT(ev, len)) {
+      if(ev->mask & FAN_Q_OVERFLOW) {
+        pending_clear();
+        pollall = 1;
+        continue;
+      }
+      fid = (struct fanotify_event_info_fid *)(ev+1);
+      /* DFID is used for events on the directory itself */
+      if(ev->event_len <= sizeof(*ev) || (fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME
+          && fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID))
+        continue;
+      if((path = fanotify_path((const fsid_t *)&fid->fsid, (struct file_handle *)fid->handle)) != NULL)
+        pending_add(path, strlen(path));
+    }
+  }
+}
+#endif
+
+
+/* Moves the events the kernel has queued for us into the pending set */
+static void watch_read(void) {
+#if HAVE_SYS_INOTIFY_H
+  if(mode == W_INOTIFY)
+    inotify_read();
+#endif
+#if USE_FANOTIFY
+  if(mode == W_FANOTIFY)
+    fanotify_read();
+#endif
+}
+
+
+void watch_root(const char *path) {
+  free(top);
+  top = xstrdup(path);
+}
+
+
+void watch_dir(const char *path, uint64_t dev) {
+  if(!watch_enabled)
+    return;
+  if(mode == W_NONE)
+    start();
+#if HAVE_SYS_INOTIFY_H
+  if(mode == W_INOTIFY)
+    inotify_dir(path);
+#endif
+#if USE_FANOTIFY
+  if(mode == W_FANOTIFY)
+    fanotify_dir(path, dev);
+#endif
+  (void)dev;
+  /* don't let the kernel queue overflow during a long scan */
+  if(++added % 256 == 0)
+    watch_read();
+}
+
+
+/* Finds the directory at path, or returns NULL when it's not in the tree */
+static struct dir *lookup(struct dir *root, const char *path) {
+  struct dir *d = root;
+  size_t len = strlen(root->name), n;
+
+  if(strncmp(path, root->name, len) != 0 || (len > 1 && path[len] && path[len] != '/'))
+    return NULL;
+  for(path+=len; d && *path; path+=n) {
+    while(*path == '/')
+      path++;
+    if(!*path)
+      break;
+    n = strcspn(path, "/");
+    for(d=d->sub; d; d=d->next)
+      if(d->flags & FF_DIR && strncmp(d->name, path, n) == 0 && !d->name[n])
+        break;
+  }
+  return d;
+}
+
+
+/* Refreshes a single directory in the background and takes the browser back
+ * to where it was, as far as that still exists */
+static void watch_refresh(struct dir *d, int shallow) {
+  char *cur, *sel = NULL, *cache = cache_file, *sep, **names;
+  struct dir *t;
+  int ui = dir_ui, i, n = 0;
+
+  /* The root is the listing of the backups, which waits for tmutil to write
+   * it (see listbackups()), so a full refresh does its subdirectories one by
+   * one instead. Those are replaced by the refresh, hence the names. */
+  if(!d->parent) {
+    if(shallow)
+      return;
+    for(t=d->sub; t; t=t->next)
+      n++;
+    names = xmalloc((n+1)*sizeof(*names));
+    for(n=0, t=d->sub; t; t=t->next)
+      if(t->flags & FF_DIR)
+        names[n++] = xstrdup(t->name);
+    for(i=0; i<n; i++) {
+      for(t=d->sub; t && strcmp(t->name, names[i]) != 0; t=t->next)
+        ;
+      if(t)
+        watch_refresh(t, 0);
+      free(names[i]);
+    }
+    free(names);
+    return;
+  }
+
+  cur = xstrdup(getpath(dirlist_par));
+  if((t = dirlist_get(0)) != NULL && t != dirlist_parent)
+    sel = xstrdup(t->name);
+
+  /* no progress window, and don't rewrite the cache for every change: it
+   * may live in the watched tree itself */
+  dir_ui = 0;
+  cache_file = NULL;
+  dir_mem_init(d);
+  if(shallow)
+    dir_scan_watch(d);
+  else
+    dir_scan_refresh(d);
+  dir_process();
+  dir_ui = ui;
+  cache_file = cache;
+
+  /* dir_process() opened the refreshed directory in the browser */
+  while((t = lookup(getroot(dirlist_par), cur)) == NULL && (sep = strrchr(cur, '/')) != NULL) {
+    *sep = 0;
+    free(sel);
+    sel = NULL;
+  }
+  if(t) {
+    browse_init(t);
+    for(t=t->sub; sel && t; t=t->next)
+      if(strcmp(t->name, sel) == 0) {
+        dirlist_select(t);
+        break;
+      }
+    dirlist_top(-3);
+  }
+  free(cur);
+  free(sel);
+}
+
+
+static int pathcmp(const void *a, const void *b) {
+  size_t la = strlen(*(char * const *)a), lb = strlen(*(char * const *)b);
+  return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+
+void watch_process(void) {
+  struct dir *d;
+  char **list;
+  int64_t now;
+  khint_t k;
+  int i, n = 0;
+
+  if(mode == W_NONE || !dirlist_par)
+    return;
+  watch_read();
+
+  now = now_ms();
+  if(mode == W_POLL && now - lastpoll >= WATCH_POLL)
+    pollall = 1;
+  if(now - lastapply < WATCH_DELAY || (!pollall && kh_size(pending) == 0))
+    return;
+  lastapply = now;
+
+  if(pollall) {
+    pending_clear();
+    pollall = 0;
+    lastpoll = now;
+    watch_refresh(getroot(dirlist_par), 0);
+    return;
+  }
+
+  /* Parents go first, so that a subdirectory that disappeared with its parent
+   * isn't looked for. Refreshing may add new events to the set. */
+  list = xmalloc(kh_size(pending)*sizeof(*list));
+  KH_FOREACH(pending, k)
+    list[n++] = kh_key(pending, k);
+  ps_s_clear(pending);
+  qsort(list, n, sizeof(*list), pathcmp);
+
+  for(i=0; i<n; i++) {
+    if(dirlist_par && (d = lookup(getroot(dirlist_par), list[i])) != NULL)
+      watch_refresh(d, 1);
+    free(list[i]);
+  }
+  free(list);
+}
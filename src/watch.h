@@ -0,0 +1,47 @@
+/* ncdu - NCurses Disk Usage
+
+  Copyright (c) Yorhel
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef _watch_h
+#define _watch_h
+
+#include "global.h"
+
+/* Whether the tree is kept up to date with changes on disk after the scan */
+extern int watch_enabled;
+
+/* Sets the root of the tree, events outside of it are ignored. Called by the
+ * scanner with the absolute path of a new scan, refreshes keep the root. */
+void watch_root(const char *);
+
+/* Starts watching a directory, called by the scanner for every directory it
+ * enters with its absolute path and device */
+void watch_dir(const char *, uint64_t);
+
+/* Applies the changes that were seen since the last call, by refreshing the
+ * directories they happened in. Only does something when the browser is
+ * open and enough time has passed since the last update. */
+void watch_process(void);
+
+#endif